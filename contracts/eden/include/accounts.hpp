@@ -63,7 +63,7 @@ namespace eden
      private:
       eosio::name contract;
       account_table_type account_tb;
-      globals globals;
+      ::eden::globals globals;
 
      public:
       accounts(eosio::name contract, eosio::name scope = eosio::name{default_scope})
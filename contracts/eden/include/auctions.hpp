@@ -46,7 +46,7 @@ namespace eden
      private:
       eosio::name contract;
       auction_table_type auction_tb;
-      globals globals;
+      ::eden::globals globals;
 
      public:
       explicit auctions(eosio::name contract)
@@ -0,0 +1,91 @@
+#pragma once
+
+// C API of the native micro-chain (libeden-micro-chain.so). It matches the exports of the
+// wasm build (see eden-subchain-client's EdenSubchain.ts), so that the box can load either.
+//
+// Functions which produce data leave it in a result buffer; getResult and getResultSize
+// read it. The buffer is valid until the next call which replaces it.
+//
+// Not thread safe, except for querySnapshot. A failed check in the wasm build traps; in the
+// native build it throws out of the C API, which terminates the process.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+   void initialize(uint32_t eden_account_low,
+                   uint32_t eden_account_high,
+                   uint32_t token_account_low,
+                   uint32_t token_account_high,
+                   uint32_t atomic_account_low,
+                   uint32_t atomic_account_high,
+                   uint32_t atomicmarket_account_low,
+                   uint32_t atomicmarket_account_high);
+
+   void* allocateMemory(uint32_t size);
+   void freeMemory(void* p);
+   uint32_t getResultSize();
+   const char* getResult();
+
+   bool addEosioBlockJson(const char* json, uint32_t size, uint32_t eosio_irreversible);
+   bool addBlock(const char* data, uint32_t size, uint32_t eosio_irreversible);
+   bool getShipBlocksRequest(uint32_t block_num);
+   bool pushShipMessage(const char* data, uint32_t size);
+   uint32_t pushShipMessages(const char* data, uint32_t size, uint32_t count);
+   uint32_t setIrreversible(uint32_t irreversible);
+   void setHistoryRetention(uint32_t days);
+   void trimBlocks();
+   void undoBlockNum(uint32_t blockNum);
+   void undoEosioNum(uint32_t eosioNum);
+
+   void setRecordDeltas(bool enable);
+   void getBlockDeltas();
+   uint32_t subscribe(const char* query,
+                      uint32_t size,
+                      const char* variables,
+                      uint32_t variables_size);
+   bool unsubscribe(uint32_t id);
+   void getSubscriptionResults();
+
+   bool getBlock(uint32_t num);
+   uint32_t getBlocks(uint32_t from, uint32_t to, uint32_t max_bytes);
+   void exportSnapshot();
+   void importSnapshot(const char* data, uint32_t size);
+   uint32_t getSchemaSize();
+   const char* getSchema();
+   void query(const char* query, uint32_t size, const char* variables, uint32_t variables_size);
+
+   // Limits on the estimated cost of queries and subscriptions, and on the fields and list
+   // items they visit. 0 removes a limit.
+   void setQueryLimits(uint32_t max_cost, uint32_t max_steps);
+
+   // Native only. Opens (or creates) the block file at path and moves irreversible blocks
+   // into it from then on, so memory holds only reversible blocks. getBlock and queries
+   // still see the archived blocks. The file must continue from, or overlap, the blocks in
+   // memory.
+   void openBlockFile(const char* path, uint32_t size);
+
+   // Native only. While enabled, the micro-chain keeps read-only copies of its state for
+   // querySnapshot, updated after each change (e.g. each block). There are two copies, so
+   // this triples the memory the state's rows take. Disabling waits for running
+   // querySnapshot calls to finish.
+   void setQuerySnapshots(bool enable);
+
+   // Native only. Like query, but runs against the state as of the last change, without
+   // waiting for the thread which adds blocks. While a query which started before the
+   // last change is still running, the state it sees may lag by a few changes. May be called from any number of threads at
+   // once, alongside the other functions. Returns the result in a buffer which the caller
+   // frees with freeMemory, or NULL if snapshots aren't enabled.
+   char* querySnapshot(const char* query,
+                       uint32_t size,
+                       const char* variables,
+                       uint32_t variables_size,
+                       uint32_t* result_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <eosio/dispatcher.hpp>
 #include <sessions.hpp>
 
@@ -17,6 +18,74 @@ namespace eden
       T inst(contract, contract, ds);
       std::apply([&](auto&... args) { (inst.*func)(current_session, std::move(args)...); }, t);
    }
+
+   inline constexpr uint32_t no_verb_index = ~uint32_t(0);
+
+   // An action declared with EDEN_ACTIONS (notifications aren't included)
+   struct action_info
+   {
+      eosio::name name;
+      uint32_t verb_index = no_verb_index;  // session verb index, if it's a verb
+   };
+
+   // Finds actions by name or by verb index in O(1): an open-addressed hash table of names,
+   // and a table indexed by verb. Both hold positions in actions. Verb indices must be less
+   // than the number of actions.
+   template <std::size_t N>
+   class action_lookup
+   {
+     public:
+      static constexpr uint32_t not_found = ~uint32_t(0);
+
+      constexpr explicit action_lookup(const std::array<action_info, N>& actions)
+      {
+         for (uint32_t i = 0; i < N; ++i)
+         {
+            auto slot = first_slot(actions[i].name);
+            while (slots[slot])
+               slot = (slot + 1) % num_slots;
+            slots[slot] = i + 1;
+            if (actions[i].verb_index != no_verb_index)
+               verbs[actions[i].verb_index] = i + 1;
+         }
+         names = actions;
+      }
+
+      constexpr uint32_t find(eosio::name name) const
+      {
+         for (auto slot = first_slot(name); slots[slot]; slot = (slot + 1) % num_slots)
+            if (names[slots[slot] - 1].name == name)
+               return slots[slot] - 1;
+         return not_found;
+      }
+
+      constexpr uint32_t find_verb(uint32_t verb_index) const
+      {
+         return verb_index < N ? verbs[verb_index] - 1 : not_found;
+      }
+
+      constexpr const action_info& operator[](uint32_t i) const { return names[i]; }
+      static constexpr std::size_t size() { return N; }
+
+     private:
+      // A power of 2, at most half full, so probes stay short
+      static constexpr int slot_bits = [] {
+         int bits = 1;
+         while ((std::size_t(1) << bits) < 2 * N)
+            ++bits;
+         return bits;
+      }();
+      static constexpr std::size_t num_slots = std::size_t(1) << slot_bits;
+
+      static constexpr std::size_t first_slot(eosio::name name)
+      {
+         return (name.value * 0x9e37'79b9'7f4a'7c15) >> (64 - slot_bits);
+      }
+
+      std::array<action_info, N> names{};
+      std::array<uint32_t, num_slots> slots{};  // position + 1; 0 is empty
+      std::array<uint32_t, N> verbs{};          // position + 1; 0 is unused
+   };
 }  // namespace eden
 
 #define EOSIO_MATCH_ACTIONeden_verb EOSIO_MATCH_YES
@@ -52,26 +121,23 @@ namespace eden
 #define EDEN_GET_SESSION_ACTION(type, MEMBERS) \
    BOOST_PP_SEQ_FOR_EACH(EDEN_GET_SESSION_ACTION_INTERNAL, type, MEMBERS)
 
-#define EDEN_NAME_FOR_SESSION_ACTION_INTERNAL_1(r, type, member) \
-   case EDEN_EXTRACT_SESSION_ACTION_INDEX(member):               \
-      return BOOST_PP_CAT(BOOST_PP_STRINGIZE(EOSIO_EXTRACT_ACTION_NAME(member)), _n);
-#define EDEN_NAME_FOR_SESSION_ACTION_INTERNAL(r, type, member)                              \
-   BOOST_PP_IIF(EDEN_MATCH_SESSION_ACTION(member), EDEN_NAME_FOR_SESSION_ACTION_INTERNAL_1, \
-                EOSIO_EMPTY)                                                                \
-   (r, type, member)
-#define EDEN_NAME_FOR_SESSION_ACTION(type, MEMBERS) \
-   BOOST_PP_SEQ_FOR_EACH(EDEN_NAME_FOR_SESSION_ACTION_INTERNAL, type, MEMBERS)
-
-#define EDEN_INDEX_FOR_SESSION_ACTION_INTERNAL_1(r, type, member)                       \
-   if (name == BOOST_PP_CAT(BOOST_PP_STRINGIZE(EOSIO_EXTRACT_ACTION_NAME(member)), _n)) \
-      return EDEN_EXTRACT_SESSION_ACTION_INDEX(member);
-#define EDEN_INDEX_FOR_SESSION_ACTION_INTERNAL(r, type, member)                              \
-   BOOST_PP_IIF(EDEN_MATCH_SESSION_ACTION(member), EDEN_INDEX_FOR_SESSION_ACTION_INTERNAL_1, \
-                EOSIO_EMPTY)                                                                 \
+#define EDEN_EXTRACT_VERB_INDEX(x) BOOST_PP_CAT(EDEN_EXTRACT_VERB_INDEX, x)
+#define EDEN_EXTRACT_VERB_INDEXaction(name, ...) ::eden::no_verb_index
+#define EDEN_EXTRACT_VERB_INDEXeden_verb(name, index, ...) index
+
+#define EDEN_ACTION_INFO_INTERNAL_1(r, type, member)                          \
+   ::eden::action_info{                                                       \
+       BOOST_PP_CAT(BOOST_PP_STRINGIZE(EOSIO_EXTRACT_ACTION_NAME(member)), _n), \
+       EDEN_EXTRACT_VERB_INDEX(member)},
+#define EDEN_ACTION_INFO_INTERNAL(r, type, member)                                   \
+   BOOST_PP_IIF(EOSIO_MATCH_NOTIFY(member), EOSIO_EMPTY, EDEN_ACTION_INFO_INTERNAL_1) \
    (r, type, member)
-#define EDEN_INDEX_FOR_SESSION_ACTION(type, MEMBERS) \
-   BOOST_PP_SEQ_FOR_EACH(EDEN_INDEX_FOR_SESSION_ACTION_INTERNAL, type, MEMBERS)
+#define EDEN_ACTION_INFO(type, MEMBERS) \
+   BOOST_PP_SEQ_FOR_EACH(EDEN_ACTION_INFO_INTERNAL, type, MEMBERS)
 
+// Besides EOSIO_ACTIONS, declares actions::session_dispatch for run's verbs, and
+// actions::action_table, which lists the actions, with actions::action_index to find them.
+// The micro-chain dispatches through the same table.
 #define EDEN_ACTIONS(CONTRACT_CLASS, CONTRACT_ACCOUNT, ...)                                     \
    EOSIO_ACTIONS(CONTRACT_CLASS, CONTRACT_ACCOUNT, __VA_ARGS__)                                 \
    namespace actions                                                                            \
@@ -92,17 +158,20 @@ namespace eden
       {                                                                                         \
          EDEN_GET_SESSION_ACTION(CONTRACT_CLASS, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))         \
       }                                                                                         \
+      inline constexpr std::array action_table{                                                 \
+          EDEN_ACTION_INFO(CONTRACT_CLASS, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))};              \
+      inline constexpr ::eden::action_lookup action_index{action_table};                        \
       inline eosio::name get_name_for_session_action(uint32_t index)                            \
       {                                                                                         \
-         switch (index)                                                                         \
-         {                                                                                      \
-            EDEN_NAME_FOR_SESSION_ACTION(CONTRACT_CLASS, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)) \
-         }                                                                                      \
-         return {};                                                                             \
+         auto i = action_index.find_verb(index);                                                \
+         return i != action_index.not_found ? action_table[i].name : eosio::name{};             \
       }                                                                                         \
       inline std::optional<uint32_t> get_index_for_session_action(eosio::name name)             \
       {                                                                                         \
-         EDEN_INDEX_FOR_SESSION_ACTION(CONTRACT_CLASS, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))   \
-         return {};                                                                             \
+         auto i = action_index.find(name);                                                      \
+         if (i == action_index.not_found)                                                       \
+            return {};                                                                          \
+         auto verb_index = action_table[i].verb_index;                                          \
+         return verb_index != ::eden::no_verb_index ? std::optional{verb_index} : std::nullopt; \
       }                                                                                         \
    }
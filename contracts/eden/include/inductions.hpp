@@ -28,7 +28,7 @@ namespace eden
       uint32_t endorsements;
       eosio::block_timestamp created_at;
       std::string video;
-      new_member_profile new_member_profile;
+      ::eden::new_member_profile new_member_profile;
 
       uint64_t primary_key() const { return id; }
       uint128_t get_invitee_inviter() const { return combine_names(invitee, inviter); }
@@ -140,7 +140,7 @@ namespace eden
       eosio::name contract;
       induction_table_type induction_tb;
       endorsement_table_type endorsement_tb;
-      globals globals;
+      ::eden::globals globals;
 
       void check_new_induction(eosio::name invitee, eosio::name inviter) const;
       bool is_valid_induction(const induction& induction) const;
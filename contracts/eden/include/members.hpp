@@ -106,7 +106,7 @@ namespace eden
      private:
       eosio::name contract;
       member_table_type member_tb;
-      globals globals;
+      ::eden::globals globals;
       member_stats_singleton member_stats;
 
      public:
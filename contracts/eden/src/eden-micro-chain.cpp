@@ -1,11 +1,16 @@
 #include <accounts.hpp>
+#include <atomic>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/key.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/ranked_index.hpp>
 #include <boost/multi_index_container.hpp>
 #include <chainbase/chainbase.hpp>
 #include <clchain/crypto.hpp>
 #include <clchain/graphql_connection.hpp>
+#include <clchain/graphql_subscription.hpp>
 #include <clchain/subchain.hpp>
+#include <eden-micro-chain.h>
 #include <eden.hpp>
 #include <eosio/abi.hpp>
 #include <eosio/from_bin.hpp>
@@ -13,6 +18,10 @@
 #include <eosio/to_bin.hpp>
 #include <events.hpp>
 #include <migrations.hpp>
+#include <unordered_map>
+#ifndef __wasm__
+#include <clchain/block_file.hpp>
+#endif
 
 using namespace eosio::literals;
 
@@ -44,18 +53,28 @@ const eosio::ecc_public_key ecc_public_key_max = {
 const eosio::public_key public_key_min_k1{std::in_place_index_t<0>{}, ecc_public_key_min};
 const eosio::public_key public_key_max_r1{std::in_place_index_t<1>{}, ecc_public_key_max};
 
-// TODO: switch to uint64_t (js BigInt) after we upgrade to nodejs >= 15
+// The wasm build exports these functions to js by name. The native build
+// (libeden-micro-chain.so) exports them with C linkage; eden-micro-chain.h declares them.
+#ifdef __wasm__
+#define MICRO_CHAIN_EXPORT(name) [[clang::export_name(#name)]]
 extern "C" void __wasm_call_ctors();
-[[clang::export_name("initialize")]] void initialize(uint32_t eden_account_low,
-                                                     uint32_t eden_account_high,
-                                                     uint32_t token_account_low,
-                                                     uint32_t token_account_high,
-                                                     uint32_t atomic_account_low,
-                                                     uint32_t atomic_account_high,
-                                                     uint32_t atomicmarket_account_low,
-                                                     uint32_t atomicmarket_account_high)
-{
+#else
+#define MICRO_CHAIN_EXPORT(name) extern "C" __attribute__((visibility("default")))
+#endif
+
+// TODO: switch to uint64_t (js BigInt) after we upgrade to nodejs >= 15
+MICRO_CHAIN_EXPORT(initialize) void initialize(uint32_t eden_account_low,
+                                               uint32_t eden_account_high,
+                                               uint32_t token_account_low,
+                                               uint32_t token_account_high,
+                                               uint32_t atomic_account_low,
+                                               uint32_t atomic_account_high,
+                                               uint32_t atomicmarket_account_low,
+                                               uint32_t atomicmarket_account_high)
+{
+#ifdef __wasm__
    __wasm_call_ctors();
+#endif
    eden_account.value = (uint64_t(eden_account_high) << 32) | eden_account_low;
    token_account.value = (uint64_t(token_account_high) << 32) | token_account_low;
    atomic_account.value = (uint64_t(atomic_account_high) << 32) | atomic_account_low;
@@ -65,21 +84,21 @@ extern "C" void __wasm_call_ctors();
    distribution_fund.value = eden_account.value + 1;
 }
 
-[[clang::export_name("allocateMemory")]] void* allocateMemory(uint32_t size)
+MICRO_CHAIN_EXPORT(allocateMemory) void* allocateMemory(uint32_t size)
 {
    return malloc(size);
 }
-[[clang::export_name("freeMemory")]] void freeMemory(void* p)
+MICRO_CHAIN_EXPORT(freeMemory) void freeMemory(void* p)
 {
    free(p);
 }
 
 std::variant<std::string, std::vector<char>> result;
-[[clang::export_name("getResultSize")]] uint32_t getResultSize()
+MICRO_CHAIN_EXPORT(getResultSize) uint32_t getResultSize()
 {
    return std::visit([](auto& data) { return data.size(); }, result);
 }
-[[clang::export_name("getResult")]] const char* getResult()
+MICRO_CHAIN_EXPORT(getResult) const char* getResult()
 {
    return std::visit([](auto& data) { return data.data(); }, result);
 }
@@ -90,6 +109,7 @@ void dump(const T& ind)
    printf("%s\n", eosio::format_json(ind).c_str());
 }
 
+#ifdef BOOST_NO_EXCEPTIONS
 namespace boost
 {
    BOOST_NORETURN void throw_exception(std::exception const& e)
@@ -101,15 +121,24 @@ namespace boost
       eosio::detail::assert_or_throw(e.what());
    }
 }  // namespace boost
+#endif
 
 struct by_id;
 struct by_pk;
+struct by_pk_hash;
 struct by_invitee;
 struct by_group;
 struct by_round;
 struct by_createdAt;
 struct by_member;
 struct by_owner;
+struct by_other_account;
+struct by_inviter;
+struct by_winner;
+struct by_candidate;
+struct by_votes;
+struct by_participating;
+struct by_expiration;
 
 template <typename T, typename... Indexes>
 using mic = boost::
@@ -155,6 +184,65 @@ using ordered_by_owner = boost::multi_index::ordered_unique<  //
     boost::multi_index::tag<by_owner>,
     boost::multi_index::key<&T::by_owner>>;
 
+template <typename T>
+using ordered_by_other_account = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_other_account>,
+    boost::multi_index::key<&T::by_other_account>>;
+
+template <typename T>
+using ordered_by_inviter = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_inviter>,
+    boost::multi_index::key<&T::by_inviter>>;
+
+template <typename T>
+using ordered_by_winner = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_winner>,
+    boost::multi_index::key<&T::by_winner>>;
+
+template <typename T>
+using ordered_by_candidate = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_candidate>,
+    boost::multi_index::key<&T::by_candidate>>;
+
+template <typename T>
+using ordered_by_votes = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_votes>,
+    boost::multi_index::key<&T::by_votes>>;
+
+template <typename T>
+using ordered_by_expiration = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_expiration>,
+    boost::multi_index::key<&T::by_expiration>>;
+
+// Ranked indices additionally support counting and offsets in O(log n)
+template <typename T>
+using ranked_by_pk = boost::multi_index::ranked_unique<  //
+    boost::multi_index::tag<by_pk>,
+    boost::multi_index::key<&T::by_pk>>;
+
+template <typename T>
+using ranked_by_createdAt = boost::multi_index::ranked_unique<  //
+    boost::multi_index::tag<by_createdAt>,
+    boost::multi_index::key<&T::by_createdAt>>;
+
+template <typename T>
+using ranked_by_participating = boost::multi_index::ranked_unique<  //
+    boost::multi_index::tag<by_participating>,
+    boost::multi_index::key<&T::by_participating>>;
+
+// The low bits of a name only hold its last characters, which are usually empty
+struct name_hash
+{
+   std::size_t operator()(eosio::name n) const { return n.value ^ (n.value >> 32); }
+};
+
+// Hashed indices find a key in O(1), for point lookups which run once per query result
+template <typename T>
+using hashed_by_pk = boost::multi_index::hashed_unique<  //
+    boost::multi_index::tag<by_pk_hash>,
+    boost::multi_index::key<&T::by_pk>,
+    name_hash>;
+
 uint64_t available_pk(const auto& table, const auto& first)
 {
    auto& idx = table.template get<by_pk>();
@@ -179,6 +267,9 @@ enum tables
    distribution_fund_table,
    nft_table,
    encryption_key_table,
+   member_witness_table,
+   vote_tally_table,
+   balance_rollup_table,
 };
 
 struct Induction;
@@ -239,14 +330,37 @@ struct status
       return migrationIndex >= boost::mp11::mp_find<eden::migration_variant, T>::value;
    }
 };
+EOSIO_REFLECT(status,
+              active,
+              community,
+              communitySymbol,
+              minimumDonation,
+              initialMembers,
+              genesisVideo,
+              collectionAttributes,
+              auctionStartingBid,
+              auctionDuration,
+              memo,
+              nextElection,
+              electionThreshold,
+              numElectionParticipants,
+              migrationIndex)
 
 struct status_object : public chainbase::object<status_table, status_object>
 {
    CHAINBASE_DEFAULT_CONSTRUCTOR(status_object)
 
    id_type id;
-   status status;
+   ::status status;
+
+   auto undo_fields()
+   {
+      return std::tie(status.active, status.nextElection, status.electionThreshold,
+                      status.numElectionParticipants, status.migrationIndex);
+   }
 };
+// Object reflections omit id; snapshots store it separately
+EOSIO_REFLECT(status_object, status)
 using status_index = mic<status_object, ordered_by_id<status_object>>;
 
 // Invariants:
@@ -266,8 +380,11 @@ struct balance_object : public chainbase::object<balance_table, balance_object>
 
    auto by_pk() const { return account; }
 };
-using balance_index =
-    mic<balance_object, ordered_by_id<balance_object>, ordered_by_pk<balance_object>>;
+EOSIO_REFLECT(balance_object, account, amount)
+using balance_index = mic<balance_object,
+                          ordered_by_id<balance_object>,
+                          ordered_by_pk<balance_object>,
+                          hashed_by_pk<balance_object>>;
 
 enum class history_desc
 {
@@ -306,7 +423,9 @@ using balance_history_key = std::tuple<eosio::name, eosio::block_timestamp, uint
 
 // Invariants:
 // * All records have a twin with account and other_account swapped, and with delta = -delta
-// * The sum of deltas for an account match the balance_object for that account
+// * The sum of deltas for an account, plus its balance_rollup_object deltas, match the
+//   balance_object for that account
+// * Only the newest rows are kept, if history retention is set; see roll_up_balance_history
 struct balance_history_object
     : public chainbase::object<balance_history_table, balance_history_object>
 {
@@ -321,10 +440,39 @@ struct balance_history_object
    history_desc description;
 
    balance_history_key by_pk() const { return {account, time, id._id}; }
+   balance_history_key by_other_account() const { return {other_account, time, id._id}; }
 };
+EOSIO_REFLECT(balance_history_object,
+              time,
+              account,
+              delta,
+              new_amount,
+              other_account,
+              description)
 using balance_history_index = mic<balance_history_object,
                                   ordered_by_id<balance_history_object>,
-                                  ordered_by_pk<balance_history_object>>;
+                                  ranked_by_pk<balance_history_object>,
+                                  ordered_by_other_account<balance_history_object>>;
+
+// An account's balance history for one day which is past the retention period (see
+// setHistoryRetention), folded from its balance_history rows. A day is either rolled up or
+// still raw, so the rollups share balance_history's key space without colliding.
+struct balance_rollup_object : public chainbase::object<balance_rollup_table, balance_rollup_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(balance_rollup_object)
+
+   id_type id;
+   eosio::name account;
+   eosio::block_timestamp day;  // start of the day
+   eosio::asset delta;          // sum of the day's deltas
+   eosio::asset new_amount;     // balance at the end of the day
+
+   balance_history_key by_pk() const { return {account, day, 0}; }
+};
+EOSIO_REFLECT(balance_rollup_object, account, day, delta, new_amount)
+using balance_rollup_index = mic<balance_rollup_object,
+                                 ordered_by_id<balance_rollup_object>,
+                                 ranked_by_pk<balance_rollup_object>>;
 
 using InductionEndorser = std::pair<eosio::name, bool>;
 
@@ -338,10 +486,12 @@ struct encryption_key_object : public chainbase::object<encryption_key_table, en
 
    eosio::name by_pk() const { return account; }
 };
+EOSIO_REFLECT(encryption_key_object, account, encryptionKey)
 
 using encryption_key_index = mic<encryption_key_object,
                                  ordered_by_id<encryption_key_object>,
-                                 ordered_by_pk<encryption_key_object>>;
+                                 ordered_by_pk<encryption_key_object>,
+                                 hashed_by_pk<encryption_key_object>>;
 
 struct induction
 {
@@ -362,12 +512,13 @@ struct induction_object : public chainbase::object<induction_table, induction_ob
    CHAINBASE_DEFAULT_CONSTRUCTOR(induction_object)
 
    id_type id;
-   induction induction;
+   ::induction induction;
 
    uint64_t by_pk() const { return induction.id; }
    std::pair<eosio::name, uint64_t> by_invitee() const { return {induction.invitee, induction.id}; }
    InductionCreatedAtKey by_createdAt() const { return {induction.createdAt, induction.id}; }
 };
+EOSIO_REFLECT(induction_object, induction)
 using induction_index = mic<induction_object,
                             ordered_by_id<induction_object>,
                             ordered_by_pk<induction_object>,
@@ -386,21 +537,60 @@ struct member
    bool participating = false;
    eosio::block_timestamp createdAt;
 };
+EOSIO_REFLECT(member,
+              account,
+              inviter,
+              inductionWitnesses,
+              profile,
+              inductionVideo,
+              participating,
+              createdAt)
 
 struct member_object : public chainbase::object<member_table, member_object>
 {
    CHAINBASE_DEFAULT_CONSTRUCTOR(member_object)
 
    id_type id;
-   member member;
+   ::member member;
 
    eosio::name by_pk() const { return member.account; }
    MemberCreatedAtKey by_createdAt() const { return {member.createdAt, member.account}; }
+   std::pair<eosio::name, eosio::name> by_inviter() const
+   {
+      return {member.inviter, member.account};
+   }
+   // Participants sort after everyone else, so they're a contiguous range
+   std::pair<bool, eosio::name> by_participating() const
+   {
+      return {member.participating, member.account};
+   }
+   auto undo_fields() { return std::tie(member.participating); }
 };
+EOSIO_REFLECT(member_object, member)
 using member_index = mic<member_object,
                          ordered_by_id<member_object>,
-                         ordered_by_pk<member_object>,
-                         ordered_by_createdAt<member_object>>;
+                         ranked_by_pk<member_object>,
+                         ranked_by_createdAt<member_object>,
+                         ordered_by_inviter<member_object>,
+                         hashed_by_pk<member_object>,
+                         ranked_by_participating<member_object>>;
+
+// Reverse index of member::inductionWitnesses. It's derived from the members table, so
+// snapshots don't store it.
+struct member_witness_object : public chainbase::object<member_witness_table, member_witness_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(member_witness_object)
+
+   id_type id;
+   eosio::name witness;
+   eosio::name member;
+
+   std::pair<eosio::name, eosio::name> by_pk() const { return {witness, member}; }
+};
+EOSIO_REFLECT(member_witness_object, witness, member)
+using member_witness_index = mic<member_witness_object,
+                                 ordered_by_id<member_witness_object>,
+                                 ordered_by_pk<member_witness_object>>;
 
 using SessionKey = std::tuple<eosio::name, eosio::public_key>;
 
@@ -415,9 +605,13 @@ struct session_object : public chainbase::object<session_table, session_object>
    std::string description;
 
    SessionKey by_pk() const { return {eden_account, key}; }
+   std::pair<eosio::block_timestamp, id_type> by_expiration() const { return {expiration, id}; }
 };
-using session_index =
-    mic<session_object, ordered_by_id<session_object>, ordered_by_pk<session_object>>;
+EOSIO_REFLECT(session_object, eden_account, key, expiration, description)
+using session_index = mic<session_object,
+                          ordered_by_id<session_object>,
+                          ordered_by_pk<session_object>,
+                          ordered_by_expiration<session_object>>;
 
 struct election_object : public chainbase::object<election_table, election_object>
 {
@@ -436,6 +630,16 @@ struct election_object : public chainbase::object<election_table, election_objec
 
    auto by_pk() const { return time; }
 };
+EOSIO_REFLECT(election_object,
+              time,
+              seeding,
+              results_available,
+              seeding_start_time,
+              seeding_end_time,
+              seed,
+              num_rounds,
+              num_participants,
+              final_group_id)
 using election_index =
     mic<election_object, ordered_by_id<election_object>, ordered_by_pk<election_object>>;
 
@@ -460,6 +664,18 @@ struct election_round_object : public chainbase::object<election_round_table, el
 
    ElectionRoundKey by_round() const { return {election_time, round}; }
 };
+EOSIO_REFLECT(election_round_object,
+              election_time,
+              round,
+              num_participants,
+              num_groups,
+              requires_voting,
+              groups_available,
+              voting_started,
+              voting_finished,
+              results_available,
+              voting_begin,
+              voting_end)
 using election_round_index = mic<election_round_object,
                                  ordered_by_id<election_round_object>,
                                  ordered_by_round<election_round_object>>;
@@ -479,11 +695,14 @@ struct election_group_object : public chainbase::object<election_group_table, el
 
    ElectionGroupKey by_pk() const { return {election_time, round, first_member}; }
    ElectionGroupByRoundKey by_round() const { return {election_time, round, id._id}; }
+   std::pair<eosio::name, uint64_t> by_winner() const { return {winner, id._id}; }
 };
+EOSIO_REFLECT(election_group_object, election_time, round, first_member, winner)
 using election_group_index = mic<election_group_object,
                                  ordered_by_id<election_group_object>,
                                  ordered_by_pk<election_group_object>,
-                                 ordered_by_round<election_group_object>>;
+                                 ordered_by_round<election_group_object>,
+                                 ordered_by_winner<election_group_object>>;
 
 struct vote_object : public chainbase::object<vote_table, vote_object>
 {
@@ -499,11 +718,38 @@ struct vote_object : public chainbase::object<vote_table, vote_object>
 
    vote_key by_pk() const { return {voter, election_time, round}; }
    auto by_group() const { return std::tuple{group_id, voter}; }
+   std::pair<eosio::name, uint64_t> by_candidate() const { return {candidate, id._id}; }
 };
+EOSIO_REFLECT(vote_object, election_time, round, group_id, voter, candidate, video)
 using vote_index = mic<vote_object,
                        ordered_by_id<vote_object>,
-                       ordered_by_pk<vote_object>,
-                       ordered_by_group<vote_object>>;
+                       ranked_by_pk<vote_object>,
+                       ordered_by_group<vote_object>,
+                       ordered_by_candidate<vote_object>>;
+
+// Number of votes for each candidate in a group, kept up to date as votes change so
+// clients don't need to count them. It's derived from the votes table, so snapshots don't
+// store it.
+struct vote_tally_object : public chainbase::object<vote_tally_table, vote_tally_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(vote_tally_object)
+
+   id_type id;
+   uint64_t group_id;
+   eosio::name candidate;
+   uint16_t votes = 0;
+
+   std::pair<uint64_t, eosio::name> by_pk() const { return {group_id, candidate}; }
+   // Most votes first; ties by candidate
+   auto by_votes() const { return std::tuple{group_id, uint16_t(~votes), candidate}; }
+   std::pair<eosio::name, uint64_t> by_candidate() const { return {candidate, id._id}; }
+};
+EOSIO_REFLECT(vote_tally_object, group_id, candidate, votes)
+using vote_tally_index = mic<vote_tally_object,
+                             ordered_by_id<vote_tally_object>,
+                             ordered_by_pk<vote_tally_object>,
+                             ordered_by_votes<vote_tally_object>,
+                             ordered_by_candidate<vote_tally_object>>;
 
 struct distribution_object : public chainbase::object<distribution_table, distribution_object>
 {
@@ -517,6 +763,7 @@ struct distribution_object : public chainbase::object<distribution_table, distri
 
    auto by_pk() const { return time; }
 };
+EOSIO_REFLECT(distribution_object, time, started, target_amount, target_rank_distribution)
 using distribution_index = mic<distribution_object,
                                ordered_by_id<distribution_object>,
                                ordered_by_pk<distribution_object>>;
@@ -537,6 +784,12 @@ struct distribution_fund_object
 
    distribution_fund_key by_pk() const { return {owner, distribution_time, rank}; }
 };
+EOSIO_REFLECT(distribution_fund_object,
+              owner,
+              distribution_time,
+              rank,
+              initial_balance,
+              current_balance)
 using distribution_fund_index = mic<distribution_fund_object,
                                     ordered_by_id<distribution_fund_object>,
                                     ordered_by_pk<distribution_fund_object>>;
@@ -559,6 +812,7 @@ struct nft_object : public chainbase::object<nft_table, nft_object>
    nft_account_key by_member() const { return {member, createdAt, assetId}; }
    nft_account_key by_owner() const { return {owner, createdAt, assetId}; }
 };
+EOSIO_REFLECT(nft_object, member, owner, templateId, assetId, templateMint, createdAt)
 using nft_index = mic<nft_object,
                       ordered_by_id<nft_object>,
                       ordered_by_pk<nft_object>,
@@ -571,6 +825,7 @@ struct database
    chainbase::generic_index<status_index> status;
    chainbase::generic_index<balance_index> balances;
    chainbase::generic_index<balance_history_index> balance_history;
+   chainbase::generic_index<balance_rollup_index> balance_rollups;
    chainbase::generic_index<encryption_key_index> encryption_keys;
    chainbase::generic_index<induction_index> inductions;
    chainbase::generic_index<member_index> members;
@@ -582,26 +837,71 @@ struct database
    chainbase::generic_index<distribution_index> distributions;
    chainbase::generic_index<distribution_fund_index> distribution_funds;
    chainbase::generic_index<nft_index> nfts;
+   chainbase::generic_index<member_witness_index> member_witnesses;
+   chainbase::generic_index<vote_tally_index> vote_tallies;
 
    database()
    {
-      db.add_index(status);
-      db.add_index(balances);
-      db.add_index(balance_history);
-      db.add_index(encryption_keys);
-      db.add_index(inductions);
-      db.add_index(members);
-      db.add_index(sessions);
-      db.add_index(elections);
-      db.add_index(election_rounds);
-      db.add_index(election_groups);
-      db.add_index(votes);
-      db.add_index(distributions);
-      db.add_index(distribution_funds);
-      db.add_index(nfts);
+      for_each_index([&](auto& index) { db.add_index(index); });
+      db.add_index(member_witnesses);
+      db.add_index(vote_tallies);
+   }
+
+   // Visits the tables which hold chain state. Derived tables (member_witnesses,
+   // vote_tallies) are skipped.
+   template <typename F>
+   void for_each_index(F&& f)
+   {
+      f(status);
+      f(balances);
+      f(balance_history);
+      f(balance_rollups);
+      f(encryption_keys);
+      f(inductions);
+      f(members);
+      f(sessions);
+      f(elections);
+      f(election_rounds);
+      f(election_groups);
+      f(votes);
+      f(distributions);
+      f(distribution_funds);
+      f(nfts);
+   }
+
+   // Visits pointers to all tables, including derived ones, e.g. to pair up the tables of
+   // two databases.
+   template <typename F>
+   static void for_each_table(F&& f)
+   {
+      f(&database::status);
+      f(&database::balances);
+      f(&database::balance_history);
+      f(&database::balance_rollups);
+      f(&database::encryption_keys);
+      f(&database::inductions);
+      f(&database::members);
+      f(&database::sessions);
+      f(&database::elections);
+      f(&database::election_rounds);
+      f(&database::election_groups);
+      f(&database::votes);
+      f(&database::distributions);
+      f(&database::distribution_funds);
+      f(&database::nfts);
+      f(&database::member_witnesses);
+      f(&database::vote_tallies);
    }
 };
-database db;
+database live_db;
+
+// The database which this thread reads: live_db, except while a query thread runs a query
+// against a replica (see querySnapshot).
+#ifdef __wasm__
+database* db = &live_db;
+#else
+thread_local database* db = &live_db;
+#endif
 
 template <typename Tag, typename Table, typename Key, typename F>
 void add_or_modify(Table& table, const Key& key, F&& f)
@@ -661,9 +961,81 @@ const typename Table::value_type* get_ptr(Table& table, const Key& key)
    return &*it;
 }
 
+// Rows which the running query has looked up, keyed by (index, key). Resolvers look up the
+// same members, balances and elections for many results (e.g. each vote's voter and group),
+// so this keeps a query's cost proportional to the distinct rows it touches. The database
+// doesn't change while a query runs, so the rows stay valid until it finishes.
+struct query_lookups
+{
+   using key = std::pair<const void*, uint64_t>;
+   struct key_hash
+   {
+      std::size_t operator()(const key& k) const
+      {
+         return std::hash<const void*>{}(k.first) ^ std::hash<uint64_t>{}(k.second);
+      }
+   };
+   std::unordered_map<key, const void*, key_hash> rows;
+};
+
+// The running query's lookups, if it's in a query_scope
+#ifdef __wasm__
+query_lookups* lookups = nullptr;
+#else
+thread_local query_lookups* lookups = nullptr;
+#endif
+
+// Gives the queries run during its lifetime a shared lookup cache
+struct query_scope
+{
+   query_lookups cache;
+   query_scope() { lookups = &cache; }
+   query_scope(const query_scope&) = delete;
+   ~query_scope() { lookups = nullptr; }
+};
+
+uint64_t lookup_key(uint64_t id)
+{
+   return id;
+}
+uint64_t lookup_key(eosio::name name)
+{
+   return name.value;
+}
+uint64_t lookup_key(eosio::block_timestamp time)
+{
+   return time.slot;
+}
+uint64_t lookup_key(const ElectionRoundKey& key)
+{
+   return (uint64_t(std::get<0>(key).slot) << 8) | std::get<1>(key);
+}
+
+// Like get_ptr, but remembers the result for the rest of the query
+template <typename Tag, typename Table, typename Key>
+const typename Table::value_type* get_ptr_cached(Table& table, const Key& key)
+{
+   if (!lookups)
+      return get_ptr<Tag>(table, key);
+   auto [it, inserted] =
+       lookups->rows.try_emplace({&table.template get<Tag>(), lookup_key(key)}, nullptr);
+   if (inserted)
+      it->second = get_ptr<Tag>(table, key);
+   return static_cast<const typename Table::value_type*>(it->second);
+}
+
+// Like get, but remembers the result for the rest of the query
+template <typename Tag, typename Table, typename Key>
+const auto& get_cached(Table& table, const Key& key)
+{
+   auto* obj = get_ptr_cached<Tag>(table, key);
+   eosio::check(obj, "missing record");
+   return *obj;
+}
+
 const auto& get_status()
 {
-   auto& idx = db.status.get<by_id>();
+   auto& idx = db->status.get<by_id>();
    eosio::check(idx.size() == 1, "missing genesis action");
    return *idx.begin();
 }
@@ -697,12 +1069,14 @@ struct Balance
                                     std::optional<uint32_t> first,
                                     std::optional<uint32_t> last,
                                     std::optional<std::string> before,
-                                    std::optional<std::string> after) const;
+                                    std::optional<std::string> after,
+                                    std::optional<uint32_t> offset) const;
 };
 EOSIO_REFLECT2(Balance,
                account,
                amount,
-               method(history, "gt", "ge", "lt", "le", "first", "last", "before", "after"))
+               method(history, "gt", "ge", "lt", "le", "first", "last", "before", "after",
+                      "offset"))
 
 constexpr const char BalanceConnection_name[] = "BalanceConnection";
 constexpr const char BalanceEdge_name[] = "BalanceEdge";
@@ -711,25 +1085,152 @@ using BalanceConnection = clchain::Connection<
 
 Balance get_balance(eosio::name account)
 {
-   if (auto* obj = get_ptr<by_pk>(db.balances, account))
+   if (auto* obj = get_ptr_cached<by_pk_hash>(db->balances, account))
       return Balance{account, obj};
    else
       return Balance{account, nullptr};
 }
 
+// Either a balance_history row or, for days past the retention period, a daily rollup
 struct BalanceHistory
 {
-   const balance_history_object* obj;
+   const balance_history_object* obj = nullptr;
+   const balance_rollup_object* rollup = nullptr;
 
-   eosio::block_timestamp time() const { return obj->time; }
-   Balance balance() const { return get_balance(obj->account); }
-   eosio::asset delta() const { return obj->delta; }
-   eosio::asset newAmount() const { return obj->new_amount; }
-   Balance otherBalance() const { return get_balance(obj->other_account); }
-   std::string description() const { return history_desc_str[(int)obj->description]; }
+   balance_history_key key() const { return obj ? obj->by_pk() : rollup->by_pk(); }
+
+   eosio::block_timestamp time() const { return obj ? obj->time : rollup->day; }
+   Balance balance() const { return get_balance(obj ? obj->account : rollup->account); }
+   eosio::asset delta() const { return obj ? obj->delta : rollup->delta; }
+   eosio::asset newAmount() const { return obj ? obj->new_amount : rollup->new_amount; }
+   std::optional<Balance> otherBalance() const
+   {
+      return obj ? std::optional{get_balance(obj->other_account)} : std::nullopt;
+   }
+   std::string description() const
+   {
+      return obj ? history_desc_str[(int)obj->description] : "daily rollup";
+   }
 };
 EOSIO_REFLECT2(BalanceHistory, time, balance, delta, newAmount, otherBalance, description)
 
+// Both tiers of balance history, merged in balance_history_key order. It reads the thread's
+// db. Both tables are ranked, so counts take O(log n) and offsets O(log² n).
+struct balance_history_view
+{
+   using rollup_index = std::decay_t<decltype(db->balance_rollups.get<by_pk>())>;
+   using raw_index = std::decay_t<decltype(db->balance_history.get<by_pk>())>;
+   using rollup_iterator = decltype(std::declval<const rollup_index&>().begin());
+   using raw_iterator = decltype(std::declval<const raw_index&>().begin());
+
+   static const rollup_index& rollups() { return db->balance_rollups.get<by_pk>(); }
+   static const raw_index& raws() { return db->balance_history.get<by_pk>(); }
+
+   class iterator
+   {
+     public:
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = BalanceHistory;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const BalanceHistory*;
+      using reference = const BalanceHistory&;
+      static constexpr bool holds_element = true;
+
+      iterator() = default;
+      iterator(rollup_iterator rollup_it, raw_iterator raw_it)
+          : rollup_it{rollup_it}, raw_it{raw_it}
+      {
+         update();
+      }
+
+      const BalanceHistory& operator*() const { return current; }
+      const BalanceHistory* operator->() const { return &current; }
+      bool operator==(const iterator& rhs) const
+      {
+         return rollup_it == rhs.rollup_it && raw_it == rhs.raw_it;
+      }
+
+      iterator& operator++()
+      {
+         if (current.rollup)
+            ++rollup_it;
+         else
+            ++raw_it;
+         update();
+         return *this;
+      }
+
+      // Steps back to the later of the previous rollup and the previous raw row
+      iterator& operator--()
+      {
+         if (raw_it == raws().begin() ||
+             (rollup_it != rollups().begin() &&
+              std::prev(raw_it)->by_pk() < std::prev(rollup_it)->by_pk()))
+            --rollup_it;
+         else
+            --raw_it;
+         update();
+         return *this;
+      }
+
+     private:
+      friend balance_history_view;
+
+      rollup_iterator rollup_it;
+      raw_iterator raw_it;
+      BalanceHistory current;
+
+      // Rollups come first on equal keys
+      void update()
+      {
+         if (rollup_it != rollups().end() &&
+             (raw_it == raws().end() || !(raw_it->by_pk() < rollup_it->by_pk())))
+            current = {nullptr, &*rollup_it};
+         else if (raw_it != raws().end())
+            current = {&*raw_it, nullptr};
+         else
+            current = {};
+      }
+   };
+
+   iterator begin() const { return {rollups().begin(), raws().begin()}; }
+   iterator end() const { return {rollups().end(), raws().end()}; }
+   iterator lower_bound(const balance_history_key& key) const
+   {
+      return {rollups().lower_bound(key), raws().lower_bound(key)};
+   }
+   iterator upper_bound(const balance_history_key& key) const
+   {
+      return {rollups().upper_bound(key), raws().upper_bound(key)};
+   }
+
+   std::size_t rank(const iterator& it) const
+   {
+      return rollups().rank(it.rollup_it) + raws().rank(it.raw_it);
+   }
+
+   // Binary searches for the number of rollups among the first n elements
+   iterator nth(std::size_t n) const
+   {
+      auto& r = rollups();
+      auto& h = raws();
+      if (n >= r.size() + h.size())
+         return end();
+      std::size_t lo = n - std::min(n, h.size());
+      std::size_t hi = std::min(n, r.size());
+      while (lo < hi)
+      {
+         auto mid = lo + (hi - lo) / 2;
+         if (h.nth(n - mid - 1)->by_pk() < r.nth(mid)->by_pk())
+            hi = mid;
+         else
+            lo = mid + 1;
+      }
+      return {r.nth(lo), h.nth(n - lo)};
+   }
+};
+const balance_history_view all_balance_history;
+
 BalanceHistoryConnection Balance::history(std::optional<eosio::block_timestamp> gt,
                                           std::optional<eosio::block_timestamp> ge,
                                           std::optional<eosio::block_timestamp> lt,
@@ -737,7 +1238,8 @@ BalanceHistoryConnection Balance::history(std::optional<eosio::block_timestamp>
                                           std::optional<uint32_t> first,
                                           std::optional<uint32_t> last,
                                           std::optional<std::string> before,
-                                          std::optional<std::string> after) const
+                                          std::optional<std::string> after,
+                                          std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<BalanceHistoryConnection, balance_history_key>(
        gt ? std::optional{balance_history_key{_account, *gt, ~uint64_t(0)}}              //
@@ -749,10 +1251,10 @@ BalanceHistoryConnection Balance::history(std::optional<eosio::block_timestamp>
        le ? std::optional{balance_history_key{_account, *le, ~uint64_t(0)}}              //
           : std::optional{balance_history_key{_account, eosio::block_timestamp::max(),   //
                                               ~uint64_t(0)}},                            //
-       first, last, before, after,                                                       //
-       db.balance_history.get<by_pk>(),                                                  //
-       [](auto& obj) { return obj.by_pk(); },                                            //
-       [&](auto& obj) { return BalanceHistory{&obj}; },
+       first, last, before, after, offset,                                               //
+       all_balance_history,                                                              //
+       [](auto& history) { return history.key(); },                                      //
+       [](auto& history) { return history; },
        [](auto& balance_history, auto key) { return balance_history.lower_bound(key); },
        [](auto& balance_history, auto key) { return balance_history.upper_bound(key); });
 }
@@ -777,7 +1279,7 @@ using EncryptionKeyConnection = clchain::Connection<
 
 EncryptionKey get_encryption_key(eosio::name account)
 {
-   if (auto* obj = get_ptr<by_pk>(db.encryption_keys, account))
+   if (auto* obj = get_ptr_cached<by_pk_hash>(db->encryption_keys, account))
       return EncryptionKey{account, obj};
    else
       return EncryptionKey{account, nullptr};
@@ -786,7 +1288,7 @@ EncryptionKey get_encryption_key(eosio::name account)
 struct Member
 {
    eosio::name account;
-   const member* member;
+   const ::member* member;
 
    auto balance() const { return get_balance(account); }
    auto inviter() const { return get_member(member ? member->inviter : ""_n); }
@@ -811,7 +1313,8 @@ struct Member
                       std::optional<uint32_t> first,
                       std::optional<uint32_t> last,
                       std::optional<std::string> before,
-                      std::optional<std::string> after) const;
+                      std::optional<std::string> after,
+                      std::optional<uint32_t> offset) const;
 
    NftConnection collectedNfts(std::optional<eosio::block_timestamp> gt,
                                std::optional<eosio::block_timestamp> ge,
@@ -820,7 +1323,8 @@ struct Member
                                std::optional<uint32_t> first,
                                std::optional<uint32_t> last,
                                std::optional<std::string> before,
-                               std::optional<std::string> after) const;
+                               std::optional<std::string> after,
+                               std::optional<uint32_t> offset) const;
 
    MemberElectionConnection elections(std::optional<eosio::block_timestamp> gt,
                                       std::optional<eosio::block_timestamp> ge,
@@ -829,7 +1333,8 @@ struct Member
                                       std::optional<uint32_t> first,
                                       std::optional<uint32_t> last,
                                       std::optional<std::string> before,
-                                      std::optional<std::string> after) const;
+                                      std::optional<std::string> after,
+                                      std::optional<uint32_t> offset) const;
    DistributionFundConnection distributionFunds(std::optional<eosio::block_timestamp> gt,
                                                 std::optional<eosio::block_timestamp> ge,
                                                 std::optional<eosio::block_timestamp> lt,
@@ -837,7 +1342,8 @@ struct Member
                                                 std::optional<uint32_t> first,
                                                 std::optional<uint32_t> last,
                                                 std::optional<std::string> before,
-                                                std::optional<std::string> after) const;
+                                                std::optional<std::string> after,
+                                                std::optional<uint32_t> offset) const;
 };
 EOSIO_REFLECT2(
     Member,
@@ -850,14 +1356,14 @@ EOSIO_REFLECT2(
     participating,
     createdAt,
     encryptionKey,
-    method(nfts, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(collectedNfts, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(elections, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(distributionFunds, "gt", "ge", "lt", "le", "first", "last", "before", "after"))
+    method(nfts, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(collectedNfts, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(elections, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(distributionFunds, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"))
 
 std::optional<Member> get_member(eosio::name account, bool allow_lsb)
 {
-   if (auto* member_object = get_ptr<by_pk>(db.members, account))
+   if (auto* member_object = get_ptr_cached<by_pk_hash>(db->members, account))
       return Member{account, &member_object->member};
    else if (account.value && (!(account.value & 0x0f) || allow_lsb))
       return Member{account, nullptr};
@@ -917,7 +1423,7 @@ EOSIO_REFLECT2(InductionEndorsingMemberStatus, member, endorsed)
 struct Induction
 {
    uint64_t id;
-   const induction* induction;
+   const ::induction* induction;
 
    auto inviteeAccount() const { return induction->invitee; }
    auto inviter() const { return InductionEndorsingMemberStatus{induction->inviter}; }
@@ -938,7 +1444,7 @@ EOSIO_REFLECT2(Induction, id, inviteeAccount, inviter, witnesses, profile, video
 
 struct Status
 {
-   const status* status;
+   const ::status* status;
 
    bool active() const { return status->active; }
    const std::string& community() const { return status->community; }
@@ -976,6 +1482,8 @@ constexpr const char ElectionGroupEdge_name[] = "ElectionGroupEdge";
 using ElectionGroupConnection = clchain::Connection<
     clchain::ConnectionConfig<ElectionGroup, ElectionGroupConnection_name, ElectionGroupEdge_name>>;
 
+struct VoteTally;
+
 struct Election
 {
    const election_object* obj;
@@ -999,7 +1507,8 @@ struct Election
                                   std::optional<uint32_t> first,
                                   std::optional<uint32_t> last,
                                   std::optional<std::string> before,
-                                  std::optional<std::string> after) const;
+                                  std::optional<std::string> after,
+                                  std::optional<uint32_t> offset) const;
    std::optional<ElectionGroup> finalGroup() const;
 };
 EOSIO_REFLECT2(Election,
@@ -1011,7 +1520,7 @@ EOSIO_REFLECT2(Election,
                seed,
                numRounds,
                numParticipants,
-               method(rounds, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
+               method(rounds, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
                finalGroup)
 
 struct MemberElection
@@ -1024,9 +1533,10 @@ struct MemberElection
    VoteConnection votes(std::optional<uint32_t> first,
                         std::optional<uint32_t> last,
                         std::optional<std::string> before,
-                        std::optional<std::string> after) const;
+                        std::optional<std::string> after,
+                        std::optional<uint32_t> offset) const;
 };
-EOSIO_REFLECT2(MemberElection, time, method(votes, "first", "last", "before", "after"))
+EOSIO_REFLECT2(MemberElection, time, method(votes, "first", "last", "before", "after", "offset"))
 
 MemberElectionConnection Member::elections(std::optional<eosio::block_timestamp> gt,
                                            std::optional<eosio::block_timestamp> ge,
@@ -1035,12 +1545,13 @@ MemberElectionConnection Member::elections(std::optional<eosio::block_timestamp>
                                            std::optional<uint32_t> first,
                                            std::optional<uint32_t> last,
                                            std::optional<std::string> before,
-                                           std::optional<std::string> after) const
+                                           std::optional<std::string> after,
+                                           std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<MemberElectionConnection, eosio::block_timestamp>(
-       gt, ge, lt, le, first, last, before, after,  //
-       db.elections.get<by_pk>(),                   //
-       [](auto& obj) { return obj.time; },          //
+       gt, ge, lt, le, first, last, before, after, offset,  //
+       db->elections.get<by_pk>(),                          //
+       [](auto& obj) { return obj.time; },                  //
        [&](auto& obj) {
           return MemberElection{account, &obj};
        },
@@ -1052,7 +1563,7 @@ struct ElectionRound
 {
    const election_round_object* obj;
 
-   Election election() const { return {&get<by_pk>(db.elections, obj->election_time)}; }
+   Election election() const { return {&get_cached<by_pk>(db->elections, obj->election_time)}; }
    uint8_t round() const { return obj->round; }
    uint16_t numParticipants() const { return obj->num_participants; }
    uint16_t numGroups() const { return obj->num_groups; }
@@ -1067,7 +1578,12 @@ struct ElectionRound
    ElectionGroupConnection groups(std::optional<uint32_t> first,
                                   std::optional<uint32_t> last,
                                   std::optional<std::string> before,
-                                  std::optional<std::string> after) const;
+                                  std::optional<std::string> after,
+                                  std::optional<uint32_t> offset) const;
+
+   // The candidate with the most votes in each group which has votes; ties go to the
+   // candidate whose name sorts first
+   std::vector<VoteTally> leaders() const;
 };
 EOSIO_REFLECT2(ElectionRound,
                election,
@@ -1081,7 +1597,8 @@ EOSIO_REFLECT2(ElectionRound,
                resultsAvailable,
                votingBegin,
                votingEnd,
-               method(groups, "first", "last", "before", "after"))
+               method(groups, "first", "last", "before", "after", "offset"),
+               leaders)
 
 ElectionRoundConnection Election::rounds(std::optional<uint8_t> gt,
                                          std::optional<uint8_t> ge,
@@ -1090,7 +1607,8 @@ ElectionRoundConnection Election::rounds(std::optional<uint8_t> gt,
                                          std::optional<uint32_t> first,
                                          std::optional<uint32_t> last,
                                          std::optional<std::string> before,
-                                         std::optional<std::string> after) const
+                                         std::optional<std::string> after,
+                                         std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<ElectionRoundConnection, ElectionRoundKey>(
        gt ? std::optional{ElectionRoundKey{obj->time, *gt}}           //
@@ -1101,8 +1619,8 @@ ElectionRoundConnection Election::rounds(std::optional<uint8_t> gt,
           : std::nullopt,                                             //
        le ? std::optional{ElectionRoundKey{obj->time, *le}}           //
           : std::optional{ElectionRoundKey{obj->time, ~uint8_t(0)}},  //
-       first, last, before, after,                                    //
-       db.election_rounds.get<by_round>(),                            //
+       first, last, before, after, offset,                            //
+       db->election_rounds.get<by_round>(),                           //
        [](auto& obj) { return obj.by_round(); },                      //
        [](auto& obj) { return ElectionRound{&obj}; },
        [](auto& rounds, auto key) { return rounds.lower_bound(key); },
@@ -1113,28 +1631,74 @@ struct ElectionGroup
 {
    const election_group_object* obj;
 
-   Election election() const { return {&get<by_pk>(db.elections, obj->election_time)}; }
+   Election election() const { return {&get_cached<by_pk>(db->elections, obj->election_time)}; }
    ElectionRound round() const
    {
-      return {&get<by_round>(db.election_rounds, ElectionRoundKey{obj->election_time, obj->round})};
+      return {&get_cached<by_round>(db->election_rounds,
+                                    ElectionRoundKey{obj->election_time, obj->round})};
    }
    auto winner() const { return get_member(obj->winner); }
    std::vector<Vote> votes() const;
+
+   // Votes for each candidate, most first
+   std::vector<VoteTally> tally() const;
 };
-EOSIO_REFLECT2(ElectionGroup, election, round, winner, votes)
+EOSIO_REFLECT2(ElectionGroup, election, round, winner, votes, tally)
+
+struct VoteTally
+{
+   const vote_tally_object* obj;
+
+   auto group() const
+   {
+      return ElectionGroup{&get_cached<by_id>(db->election_groups, obj->group_id)};
+   }
+   auto candidate() const { return get_member(obj->candidate); }
+   uint16_t votes() const { return obj->votes; }
+};
+EOSIO_REFLECT2(VoteTally, group, candidate, votes)
+
+std::vector<VoteTally> ElectionGroup::tally() const
+{
+   std::vector<VoteTally> result;
+   auto& idx = db->vote_tallies.get<by_votes>();
+   for (auto it = idx.lower_bound(std::tuple{obj->id._id, uint16_t(0), eosio::name{0}});
+        it != idx.end() && it->group_id == obj->id._id; ++it)
+   {
+      result.push_back(VoteTally{&*it});
+   }
+   return result;
+}
+
+std::vector<VoteTally> ElectionRound::leaders() const
+{
+   std::vector<VoteTally> result;
+   auto& groups = db->election_groups.get<by_round>();
+   auto& tallies = db->vote_tallies.get<by_votes>();
+   for (auto it = groups.lower_bound(ElectionGroupByRoundKey{obj->election_time, obj->round, 0});
+        it != groups.end() && it->election_time == obj->election_time && it->round == obj->round;
+        ++it)
+   {
+      auto leader = tallies.lower_bound(std::tuple{it->id._id, uint16_t(0), eosio::name{0}});
+      if (leader != tallies.end() && leader->group_id == it->id._id)
+         result.push_back(VoteTally{&*leader});
+   }
+   return result;
+}
 
 ElectionGroupConnection ElectionRound::groups(std::optional<uint32_t> first,
                                               std::optional<uint32_t> last,
                                               std::optional<std::string> before,
-                                              std::optional<std::string> after) const
+                                              std::optional<std::string> after,
+                                              std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<ElectionGroupConnection, ElectionGroupByRoundKey>(
        std::nullopt,                                                                          // gt
        std::optional{ElectionGroupByRoundKey{obj->election_time, obj->round, 0}},             // ge
        std::nullopt,                                                                          // lt
        std::optional{ElectionGroupByRoundKey{obj->election_time, obj->round, ~uint64_t(0)}},  // le
-       first, last, before, after,                                                            //
-       db.election_groups.get<by_round>(),                                                    //
+       first, last, before, after, offset,                                                    //
+       db->election_groups.get<by_round>(),                                                   //
        [](auto& obj) { return obj.by_round(); },                                              //
        [](auto& obj) { return ElectionGroup{&obj}; },
        [](auto& groups, auto key) { return groups.lower_bound(key); },
@@ -1144,7 +1708,7 @@ ElectionGroupConnection ElectionRound::groups(std::optional<uint32_t> first,
 std::optional<ElectionGroup> Election::finalGroup() const
 {
    if (obj->final_group_id)
-      return ElectionGroup{&get<by_id>(db.election_groups, *obj->final_group_id)};
+      return ElectionGroup{&get_cached<by_id>(db->election_groups, *obj->final_group_id)};
    return std::nullopt;
 }
 
@@ -1155,14 +1719,17 @@ struct Vote
    auto voter() const { return get_member(obj->voter); }
    auto candidate() const { return get_member(obj->candidate); }
    const auto& video() const { return obj->video; }
-   auto group() const { return ElectionGroup{&get<by_id>(db.election_groups, obj->group_id)}; }
+   auto group() const
+   {
+      return ElectionGroup{&get_cached<by_id>(db->election_groups, obj->group_id)};
+   }
 };
 EOSIO_REFLECT2(Vote, voter, candidate, video, group)
 
 std::vector<Vote> ElectionGroup::votes() const
 {
    std::vector<Vote> result;
-   auto& idx = db.votes.get<by_group>();
+   auto& idx = db->votes.get<by_group>();
    for (auto it = idx.lower_bound(std::tuple{obj->id._id, eosio::name{0}});
         it != idx.end() && it->group_id == obj->id._id; ++it)
    {
@@ -1174,15 +1741,16 @@ std::vector<Vote> ElectionGroup::votes() const
 VoteConnection MemberElection::votes(std::optional<uint32_t> first,
                                      std::optional<uint32_t> last,
                                      std::optional<std::string> before,
-                                     std::optional<std::string> after) const
+                                     std::optional<std::string> after,
+                                     std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<VoteConnection, vote_key>(
        std::nullopt,                                    // gt
        vote_key{account, election->time, 0},            // ge
        std::nullopt,                                    // lt
        vote_key{account, election->time, ~uint8_t(0)},  // le
-       first, last, before, after,                      //
-       db.votes.get<by_pk>(),                           //
+       first, last, before, after, offset,              //
+       db->votes.get<by_pk>(),                          //
        [](auto& obj) { return obj.by_pk(); },           //
        [](auto& obj) { return Vote{&obj}; },            //
        [](auto& votes, auto key) { return votes.lower_bound(key); },
@@ -1219,7 +1787,8 @@ DistributionFundConnection Member::distributionFunds(std::optional<eosio::block_
                                                      std::optional<uint32_t> first,
                                                      std::optional<uint32_t> last,
                                                      std::optional<std::string> before,
-                                                     std::optional<std::string> after) const
+                                                     std::optional<std::string> after,
+                                                     std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<DistributionFundConnection, distribution_fund_key>(
        gt ? std::optional{distribution_fund_key{account, *gt, ~uint8_t(0)}}               //
@@ -1231,8 +1800,8 @@ DistributionFundConnection Member::distributionFunds(std::optional<eosio::block_
        le ? std::optional{distribution_fund_key{account, *le, ~uint8_t(0)}}               //
           : std::optional{distribution_fund_key{account, eosio::block_timestamp::max(),   //
                                                 ~uint8_t(0)}},                            //
-       first, last, before, after,                                                        //
-       db.distribution_funds.get<by_pk>(),                                                //
+       first, last, before, after, offset,                                                //
+       db->distribution_funds.get<by_pk>(),                                               //
        [](auto& obj) { return obj.by_pk(); },                                             //
        [&](auto& obj) { return DistributionFund{&obj}; },
        [](auto& distribution_funds, auto key) { return distribution_funds.lower_bound(key); },
@@ -1241,8 +1810,8 @@ DistributionFundConnection Member::distributionFunds(std::optional<eosio::block_
 
 void add_genesis_member(const status& status, eosio::name member)
 {
-   db.inductions.emplace([&](auto& obj) {
-      obj.induction.id = available_pk(db.inductions, 1);
+   db->inductions.emplace([&](auto& obj) {
+      obj.induction.id = available_pk(db->inductions, 1);
       obj.induction.inviter = {eden_account, false};
       obj.induction.invitee = member;
       for (auto witness : status.initialMembers)
@@ -1271,7 +1840,8 @@ NftConnection Member::nfts(std::optional<eosio::block_timestamp> gt,
                            std::optional<uint32_t> first,
                            std::optional<uint32_t> last,
                            std::optional<std::string> before,
-                           std::optional<std::string> after) const
+                           std::optional<std::string> after,
+                           std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<NftConnection, nft_account_key>(
        gt ? std::optional{nft_account_key{account, *gt, ~uint64_t(0)}}              //
@@ -1283,8 +1853,8 @@ NftConnection Member::nfts(std::optional<eosio::block_timestamp> gt,
        le ? std::optional{nft_account_key{account, *le, ~uint64_t(0)}}              //
           : std::optional{nft_account_key{account, eosio::block_timestamp::max(),   //
                                           ~uint64_t(0)}},                           //
-       first, last, before, after,                                                  //
-       db.nfts.get<by_member>(),                                                    //
+       first, last, before, after, offset,                                          //
+       db->nfts.get<by_member>(),                                                   //
        [](auto& obj) { return obj.by_member(); },                                   //
        [&](auto& obj) { return Nft{&obj}; },
        [](auto& nfts, auto key) { return nfts.lower_bound(key); },
@@ -1298,7 +1868,8 @@ NftConnection Member::collectedNfts(std::optional<eosio::block_timestamp> gt,
                                     std::optional<uint32_t> first,
                                     std::optional<uint32_t> last,
                                     std::optional<std::string> before,
-                                    std::optional<std::string> after) const
+                                    std::optional<std::string> after,
+                                    std::optional<uint32_t> offset) const
 {
    return clchain::make_connection<NftConnection, nft_account_key>(
        gt ? std::optional{nft_account_key{account, *gt, ~uint64_t(0)}}              //
@@ -1310,8 +1881,8 @@ NftConnection Member::collectedNfts(std::optional<eosio::block_timestamp> gt,
        le ? std::optional{nft_account_key{account, *le, ~uint64_t(0)}}              //
           : std::optional{nft_account_key{account, eosio::block_timestamp::max(),   //
                                           ~uint64_t(0)}},                           //
-       first, last, before, after,                                                  //
-       db.nfts.get<by_owner>(),                                                     //
+       first, last, before, after, offset,                                          //
+       db->nfts.get<by_owner>(),                                                    //
        [](auto& obj) { return obj.by_owner(); },                                    //
        [&](auto& obj) { return Nft{&obj}; },
        [](auto& nfts, auto key) { return nfts.lower_bound(key); },
@@ -1327,7 +1898,7 @@ struct block_state
 struct action_context
 {
    const subchain::eosio_block& block;
-   block_state& block_state;
+   ::block_state& block_state;
    const subchain::transaction& transaction;
    const subchain::action& action;
 };
@@ -1345,20 +1916,23 @@ void clear_table(auto& table)
 
 void clearall()
 {
-   clear_table(db.status);
-   clear_table(db.balances);
-   clear_table(db.balance_history);
-   clear_table(db.inductions);
-   clear_table(db.members);
-   clear_table(db.sessions);
-   clear_table(db.elections);
-   clear_table(db.election_rounds);
-   clear_table(db.election_groups);
-   clear_table(db.votes);
-   clear_table(db.distributions);
-   clear_table(db.distribution_funds);
-   clear_table(db.nfts);
-   clear_table(db.encryption_keys);
+   clear_table(db->status);
+   clear_table(db->balances);
+   clear_table(db->balance_history);
+   clear_table(db->balance_rollups);
+   clear_table(db->inductions);
+   clear_table(db->members);
+   clear_table(db->sessions);
+   clear_table(db->elections);
+   clear_table(db->election_rounds);
+   clear_table(db->election_groups);
+   clear_table(db->votes);
+   clear_table(db->distributions);
+   clear_table(db->distribution_funds);
+   clear_table(db->nfts);
+   clear_table(db->encryption_keys);
+   clear_table(db->member_witnesses);
+   clear_table(db->vote_tallies);
 }
 
 void delsession(eosio::name eden_account, const eosio::public_key& key)
@@ -1369,7 +1943,7 @@ void delsession(eosio::name eden_account, const eosio::public_key& key)
 eosio::asset add_balance(eosio::name account, const eosio::asset& delta)
 {
    eosio::asset result;
-   add_or_modify<by_pk>(db.balances, account, [&](bool is_new, auto& a) {
+   add_or_modify<by_pk_hash>(db->balances, account, [&](bool is_new, auto& a) {
       if (is_new)
       {
          a.account = account;
@@ -1390,7 +1964,7 @@ void transfer_funds(eosio::block_timestamp time,
 {
    auto new_from = add_balance(from, -amount);
    auto new_to = add_balance(to, amount);
-   db.balance_history.emplace([&](auto& h) {
+   db->balance_history.emplace([&](auto& h) {
       h.time = time;
       h.account = from;
       h.delta = -amount;
@@ -1398,7 +1972,7 @@ void transfer_funds(eosio::block_timestamp time,
       h.other_account = to;
       h.description = description;
    });
-   db.balance_history.emplace([&](auto& h) {
+   db->balance_history.emplace([&](auto& h) {
       h.time = time;
       h.account = to;
       h.delta = amount;
@@ -1474,7 +2048,7 @@ void fundtransfer(const action_context& context,
 {
    transfer_funds(context.block.timestamp, distribution_fund, to, amount,
                   history_desc::fund_transfer);
-   modify<by_pk>(db.distribution_funds, distribution_fund_key{from, distribution_time, rank},
+   modify<by_pk>(db->distribution_funds, distribution_fund_key{from, distribution_time, rank},
                  [&](auto& fund) { fund.current_balance -= amount; });
 }
 
@@ -1497,9 +2071,9 @@ void genesis(std::string community,
              uint32_t auction_duration,
              std::string memo)
 {
-   auto& idx = db.status.get<by_id>();
+   auto& idx = db->status.get<by_id>();
    eosio::check(idx.empty(), "duplicate genesis action");
-   db.status.emplace([&](auto& obj) {
+   db->status.emplace([&](auto& obj) {
       obj.status.community = std::move(community);
       obj.status.communitySymbol = std::move(community_symbol);
       obj.status.minimumDonation = std::move(minimum_donation);
@@ -1517,10 +2091,10 @@ void genesis(std::string community,
 void addtogenesis(eosio::name new_genesis_member)
 {
    auto& status = get_status();
-   db.status.modify(get_status(),
-                    [&](auto& obj) { obj.status.initialMembers.push_back(new_genesis_member); });
-   for (auto& obj : db.inductions)
-      db.inductions.modify(obj, [&](auto& obj) {
+   db->status.modify(get_status(),
+                     [&](auto& obj) { obj.status.initialMembers.push_back(new_genesis_member); });
+   for (auto& obj : db->inductions)
+      db->inductions.modify(obj, [&](auto& obj) {
          obj.induction.witnesses.push_back({new_genesis_member, false});
       });
    add_genesis_member(status.status, new_genesis_member);
@@ -1535,7 +2109,7 @@ void inductinit(const action_context& context,
    // contract doesn't allow inductinit() until it transitioned to active
    const auto& status = get_status();
    if (!status.status.active)
-      db.status.modify(status, [&](auto& obj) { obj.status.active = true; });
+      db->status.modify_fields(status, [&](auto& obj) { obj.status.active = true; });
 
    std::vector<InductionEndorser> witnesses;
    for (const auto& witness : witnesses_accounts)
@@ -1543,7 +2117,7 @@ void inductinit(const action_context& context,
       witnesses.push_back(InductionEndorser{witness, false});
    }
 
-   add_or_replace<by_pk>(db.inductions, id, [&](auto& obj) {
+   add_or_replace<by_pk>(db->inductions, id, [&](auto& obj) {
       obj.induction.id = id;
       obj.induction.inviter = {inviter, false};
       obj.induction.invitee = invitee;
@@ -1554,7 +2128,7 @@ void inductinit(const action_context& context,
 
 void inductprofil(uint64_t id, eden::new_member_profile profile)
 {
-   modify<by_pk>(db.inductions, id, [&](auto& obj) {
+   modify<by_pk>(db->inductions, id, [&](auto& obj) {
       obj.induction.profile = profile;
 
       // reset endorsements
@@ -1576,7 +2150,7 @@ void inductmeetin(eosio::name account,
 
 void inductvideo(eosio::name account, uint64_t id, std::string video)
 {
-   modify<by_pk>(db.inductions, id, [&](auto& obj) {
+   modify<by_pk>(db->inductions, id, [&](auto& obj) {
       obj.induction.video = video;
 
       // reset endorsements
@@ -1590,7 +2164,23 @@ void inductvideo(eosio::name account, uint64_t id, std::string video)
 
 void inductcancel(eosio::name account, uint64_t id)
 {
-   remove_if_exists<by_pk>(db.inductions, id);
+   remove_if_exists<by_pk>(db->inductions, id);
+}
+
+void add_member_witnesses(const member& member)
+{
+   for (auto witness : member.inductionWitnesses)
+      if (!get_ptr<by_pk>(db->member_witnesses, std::pair{witness, member.account}))
+         db->member_witnesses.emplace([&](auto& obj) {
+            obj.witness = witness;
+            obj.member = member.account;
+         });
+}
+
+void remove_member_witnesses(const member& member)
+{
+   for (auto witness : member.inductionWitnesses)
+      remove_if_exists<by_pk>(db->member_witnesses, std::pair{witness, member.account});
 }
 
 void inductdonate(const action_context& context,
@@ -1598,9 +2188,12 @@ void inductdonate(const action_context& context,
                   uint64_t id,
                   eosio::asset quantity)
 {
-   auto& induction = get<by_pk>(db.inductions, id);
+   transfer_funds(context.block.timestamp, payer, master_pool, quantity,
+                  history_desc::inductdonate);
+
+   auto& induction = get<by_pk>(db->inductions, id);
 
-   auto& member = db.members.emplace([&](auto& obj) {
+   auto& member = db->members.emplace([&](auto& obj) {
       obj.member.account = induction.induction.invitee;
       obj.member.inviter = induction.induction.inviter.first;
 
@@ -1617,17 +2210,15 @@ void inductdonate(const action_context& context,
       if (obj.member.inductionVideo.empty())
          obj.member.inductionVideo = get_status().status.genesisVideo;
    });
+   add_member_witnesses(member.member);
 
-   transfer_funds(context.block.timestamp, payer, master_pool, quantity,
-                  history_desc::inductdonate);
-
-   auto& index = db.inductions.get<by_invitee>();
+   auto& index = db->inductions.get<by_invitee>();
    for (auto it = index.lower_bound(std::pair<eosio::name, uint64_t>{member.member.account, 0});
         it != index.end() && it->induction.invitee == member.member.account;)
    {
       auto next = it;
       ++next;
-      db.inductions.remove(*it);
+      db->inductions.remove(*it);
       it = next;
    }
 }
@@ -1637,8 +2228,7 @@ void inductendors(const action_context& context,
                   uint64_t id,
                   eosio::checksum256 induction_data_hash)
 {
-   auto& induction = get<by_pk>(db.inductions, id);
-   modify<by_pk>(db.inductions, id, [&](auto& obj) {
+   modify<by_pk>(db->inductions, id, [&](auto& obj) {
       if (account == obj.induction.inviter.first)
       {
          obj.induction.inviter.second = true;
@@ -1659,11 +2249,30 @@ void inductendors(const action_context& context,
 
 void resign(eosio::name account)
 {
-   remove_if_exists<by_pk>(db.members, account);
+   if (auto* obj = get_ptr<by_pk_hash>(db->members, account))
+   {
+      remove_member_witnesses(obj->member);
+      db->members.remove(*obj);
+   }
+}
+
+// Calls f(obj) on each object in idx from lower_bound(key) while pred(obj) holds. f may
+// change the object's key if that moves it out of the visited range.
+void modify_range(auto& table, const auto& idx, const auto& key, auto&& pred, auto&& f)
+{
+   for (auto it = idx.lower_bound(key); it != idx.end() && pred(*it);)
+   {
+      auto next = it;
+      ++next;
+      table.modify(*it, f);
+      it = next;
+   }
 }
 
 void rename(eosio::name old_account, eosio::name new_account)
 {
+   // Only rows which mention old_account are modified, so the undo stack only backs up
+   // those. They're found through the indices on each account field.
    auto update = [&](auto& acc) {
       if (acc == old_account)
          acc = new_account;
@@ -1671,109 +2280,170 @@ void rename(eosio::name old_account, eosio::name new_account)
    auto update_vec = [&](auto& vec) {
       std::replace(vec.begin(), vec.end(), old_account, new_account);
    };
+   auto contains = [&](const auto& vec) {
+      return std::find(vec.begin(), vec.end(), old_account) != vec.end();
+   };
 
-   db.status.modify(get_status(), [&](auto& status) { update_vec(status.status.initialMembers); });
-
-   if (auto* obj = get_ptr<by_pk>(db.balances, old_account))
-      db.balances.modify(*obj, [&](auto& obj) { obj.account = new_account; });
+   if (auto& status = get_status(); contains(status.status.initialMembers))
+      db->status.modify(status, [&](auto& status) { update_vec(status.status.initialMembers); });
 
-   for (auto& obj : db.balance_history)
-      db.balance_history.modify(obj, [&](auto& obj) {
-         update(obj.account);
-         update(obj.other_account);
-      });
+   if (auto* obj = get_ptr<by_pk_hash>(db->balances, old_account))
+      db->balances.modify(*obj, [&](auto& obj) { obj.account = new_account; });
 
-   if (auto* obj = get_ptr<by_pk>(db.encryption_keys, old_account))
-      db.encryption_keys.modify(*obj, [&](auto& obj) { obj.account = new_account; });
-
-   for (auto& obj : db.inductions)
-      db.inductions.modify(obj, [&](auto& obj) {
+   auto update_history = [&](auto& obj) {
+      update(obj.account);
+      update(obj.other_account);
+   };
+   modify_range(db->balance_history, db->balance_history.get<by_pk>(),
+                balance_history_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.account == old_account; }, update_history);
+   modify_range(db->balance_history, db->balance_history.get<by_other_account>(),
+                balance_history_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.other_account == old_account; }, update_history);
+   modify_range(db->balance_rollups, db->balance_rollups.get<by_pk>(),
+                balance_history_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.account == old_account; },
+                [&](auto& obj) { obj.account = new_account; });
+
+   if (auto* obj = get_ptr<by_pk_hash>(db->encryption_keys, old_account))
+      db->encryption_keys.modify(*obj, [&](auto& obj) { obj.account = new_account; });
+
+   // Pending inductions are few, so a scan is cheaper than maintaining more indices
+   for (auto& obj : db->inductions)
+   {
+      auto& induction = obj.induction;
+      if (induction.inviter.first != old_account &&
+          std::none_of(induction.witnesses.begin(), induction.witnesses.end(),
+                       [&](auto& w) { return w.first == old_account; }))
+         continue;
+      db->inductions.modify(obj, [&](auto& obj) {
          update(obj.induction.inviter.first);
          for (auto& w : obj.induction.witnesses)
             update(w.first);
       });
-
-   for (auto& obj : db.members)
-      db.members.modify(obj, [&](auto& obj) {
-         update(obj.member.account);
-         update(obj.member.inviter);
-         update_vec(obj.member.inductionWitnesses);
-      });
-
-   for (auto& obj : db.election_groups)
-      db.election_groups.modify(obj, [&](auto& obj) {
-         // first_member is kept as is since it's only used by events
-         // which have already occurred, and it isn't exposed to the UI
-         update(obj.winner);
-      });
-
-   for (auto& obj : db.votes)
-      db.votes.modify(obj, [&](auto& obj) {
-         update(obj.voter);
-         update(obj.candidate);
-      });
-
-   {
-      auto& idx = db.distribution_funds.get<by_pk>();
-      for (auto it = idx.lower_bound(distribution_fund_key{old_account, {}, 0});
-           it != idx.end() && it->owner == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.distribution_funds.modify(*it, [&](auto& obj) { obj.owner = new_account; });
-         it = next;
-      }
    }
 
+   if (auto* obj = get_ptr<by_pk_hash>(db->members, old_account))
    {
-      auto& idx = db.nfts.get<by_member>();
-      for (auto it = idx.lower_bound(nft_account_key{old_account, {}, 0});
-           it != idx.end() && it->member == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.nfts.modify(*it, [&](auto& obj) { obj.member = new_account; });
-         it = next;
-      }
+      for (auto witness : obj->member.inductionWitnesses)
+         if (auto* w = get_ptr<by_pk>(db->member_witnesses, std::pair{witness, old_account}))
+            db->member_witnesses.modify(*w, [&](auto& obj) { obj.member = new_account; });
+      db->members.modify(*obj, [&](auto& obj) { obj.member.account = new_account; });
    }
+   modify_range(db->members, db->members.get<by_inviter>(), std::pair{old_account, eosio::name{}},
+                [&](auto& obj) { return obj.member.inviter == old_account; },
+                [&](auto& obj) { obj.member.inviter = new_account; });
+   modify_range(db->member_witnesses, db->member_witnesses.get<by_pk>(),
+                std::pair{old_account, eosio::name{}},
+                [&](auto& obj) { return obj.witness == old_account; },
+                [&](auto& obj) {
+                   if (auto* m = get_ptr<by_pk_hash>(db->members, obj.member))
+                      db->members.modify(
+                          *m, [&](auto& obj) { update_vec(obj.member.inductionWitnesses); });
+                   obj.witness = new_account;
+                });
+
+   // first_member is kept as is since it's only used by events
+   // which have already occurred, and it isn't exposed to the UI
+   modify_range(db->election_groups, db->election_groups.get<by_winner>(),
+                std::pair{old_account, uint64_t(0)},
+                [&](auto& obj) { return obj.winner == old_account; },
+                [&](auto& obj) { obj.winner = new_account; });
+
+   auto update_vote = [&](auto& obj) {
+      update(obj.voter);
+      update(obj.candidate);
+   };
+   modify_range(db->votes, db->votes.get<by_pk>(), vote_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.voter == old_account; }, update_vote);
+   modify_range(db->votes, db->votes.get<by_candidate>(), std::pair{old_account, uint64_t(0)},
+                [&](auto& obj) { return obj.candidate == old_account; }, update_vote);
+   modify_range(db->vote_tallies, db->vote_tallies.get<by_candidate>(),
+                std::pair{old_account, uint64_t(0)},
+                [&](auto& obj) { return obj.candidate == old_account; },
+                [&](auto& obj) { obj.candidate = new_account; });
+
+   modify_range(db->distribution_funds, db->distribution_funds.get<by_pk>(),
+                distribution_fund_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.owner == old_account; },
+                [&](auto& obj) { obj.owner = new_account; });
+
+   modify_range(db->nfts, db->nfts.get<by_member>(), nft_account_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.member == old_account; },
+                [&](auto& obj) { obj.member = new_account; });
+
+   modify_range(db->nfts, db->nfts.get<by_owner>(), nft_account_key{old_account, {}, 0},
+                [&](auto& obj) { return obj.owner == old_account; },
+                [&](auto& obj) { obj.owner = new_account; });
+}  // rename
 
+// Visits only the participants, so it costs O(participants) instead of O(members)
+void clear_participating_flags()
+{
+   auto& idx = db->members.template get<by_participating>();
+   for (auto it = idx.lower_bound(std::pair{true, eosio::name{0}}); it != idx.end();)
    {
-      auto& idx = db.nfts.get<by_owner>();
-      for (auto it = idx.lower_bound(nft_account_key{old_account, {}, 0});
-           it != idx.end() && it->owner == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.nfts.modify(*it, [&](auto& obj) { obj.owner = new_account; });
-         it = next;
-      }
+      // Clearing the flag moves the member out of the range
+      auto next = std::next(it);
+      db->members.modify_fields(*it, [](auto& obj) { obj.member.participating = false; });
+      it = next;
    }
-}  // rename
+}
 
 void clear_participating()
 {
-   auto& idx = db.members.template get<by_pk>();
-   for (auto it = idx.begin(); it != idx.end(); ++it)
-      if (it->member.participating)
-         db.members.modify(*it, [](auto& obj) { obj.member.participating = false; });
-   db.status.modify(get_status(), [&](auto& status) { status.status.numElectionParticipants = 0; });
+   clear_participating_flags();
+   db->status.modify_fields(get_status(),
+                            [&](auto& status) { status.status.numElectionParticipants = 0; });
 }
 
 void electopt(eosio::name voter, bool participating)
 {
-   modify<by_pk>(db.members, voter, [&](auto& obj) { obj.member.participating = participating; });
-   db.status.modify(get_status(), [&](auto& status) {
+   db->members.modify_fields(get<by_pk_hash>(db->members, voter),
+                             [&](auto& obj) { obj.member.participating = participating; });
+   db->status.modify_fields(get_status(), [&](auto& status) {
       status.status.numElectionParticipants += participating ? 1 : -1;
    });
 }
 
+void add_vote_tally(uint64_t group_id, eosio::name candidate)
+{
+   add_or_modify<by_pk>(db->vote_tallies, std::pair{group_id, candidate},
+                        [&](bool is_new, auto& tally) {
+                           tally.group_id = group_id;
+                           tally.candidate = candidate;
+                           ++tally.votes;
+                        });
+}
+
+void remove_vote_tally(uint64_t group_id, eosio::name candidate)
+{
+   auto& tally = get<by_pk>(db->vote_tallies, std::pair{group_id, candidate});
+   if (tally.votes > 1)
+      db->vote_tallies.modify(tally, [](auto& tally) { --tally.votes; });
+   else
+      db->vote_tallies.remove(tally);
+}
+
+// Changes vote's candidate and moves the vote between its group's tallies. An empty
+// candidate is no vote.
+void set_vote_candidate(const vote_object& vote, eosio::name candidate)
+{
+   if (vote.candidate == candidate)
+      return;
+   if (vote.candidate.value)
+      remove_vote_tally(vote.group_id, vote.candidate);
+   if (candidate.value)
+      add_vote_tally(vote.group_id, candidate);
+   db->votes.modify(vote, [&](auto& vote) { vote.candidate = candidate; });
+}
+
 void electvote(uint8_t round, eosio::name voter, eosio::name candidate)
 {
-   auto& election_idx = db.elections.get<by_pk>();
+   auto& election_idx = db->elections.get<by_pk>();
    eosio::check(!election_idx.empty(), "electvote without any elections");
    auto& election = *--election_idx.end();
-   auto& vote = get<by_pk>(db.votes, std::tuple{voter, election.time, round});
-   db.votes.modify(vote, [&](auto& vote) { vote.candidate = candidate; });
+   set_vote_candidate(get<by_pk>(db->votes, std::tuple{voter, election.time, round}), candidate);
 }
 
 void electmeeting(eosio::name account,
@@ -1786,18 +2456,18 @@ void electmeeting(eosio::name account,
 
 void electvideo(uint8_t round, eosio::name voter, const std::string& video)
 {
-   auto& election_idx = db.elections.get<by_pk>();
+   auto& election_idx = db->elections.get<by_pk>();
    if (election_idx.empty())
       return;
    auto& election = *--election_idx.end();
-   auto* vote = get_ptr<by_pk>(db.votes, std::tuple{voter, election.time, round});
+   auto* vote = get_ptr<by_pk>(db->votes, std::tuple{voter, election.time, round});
    if (vote)
-      db.votes.modify(*vote, [&](auto& vote) { vote.video = video; });
+      db->votes.modify(*vote, [&](auto& vote) { vote.video = video; });
 }
 
 void setencpubkey(eosio::name member, eosio::public_key key)
 {
-   add_or_modify<by_pk>(db.encryption_keys, member, [&](bool is_new, auto& row) {
+   add_or_modify<by_pk_hash>(db->encryption_keys, member, [&](bool is_new, auto& row) {
       row.account = member;
       row.encryptionKey = key;
    });
@@ -1827,14 +2497,14 @@ void logmint(const action_context& context,
    eosio::name member_account(std::get<std::string>(account_pos->value));
 
    uint64_t template_mint = 0;
-   auto& index = db.nfts.get<by_member>();
+   auto& index = db->nfts.get<by_member>();
    for (auto it = index.lower_bound(nft_account_key{member_account, eosio::block_timestamp(0), 0});
         it != index.end() && it->member == member_account; it++)
    {
       template_mint++;
    }
 
-   db.nfts.emplace([&](auto& nft) {
+   db->nfts.emplace([&](auto& nft) {
       nft.member = member_account;
       nft.owner = new_asset_owner;
       nft.templateId = template_id;
@@ -1854,7 +2524,7 @@ void logtransfer(const action_context& context,
    if (collection_name != eden_account)
       return;
 
-   auto& index = db.nfts.get<by_pk>();
+   auto& index = db->nfts.get<by_pk>();
 
    for (const auto& asset_id : asset_ids)
    {
@@ -1864,36 +2534,33 @@ void logtransfer(const action_context& context,
          continue;
       }
 
-      db.nfts.modify(*it, [&](auto& nft) { nft.owner = to; });
+      db->nfts.modify(*it, [&](auto& nft) { nft.owner = to; });
    }
 }
 
 void handle_event(const eden::migration_event& event)
 {
-   db.status.modify(get_status(),
-                    [&](auto& status) { status.status.migrationIndex = event.index; });
+   db->status.modify_fields(get_status(),
+                            [&](auto& status) { status.status.migrationIndex = event.index; });
 }
 
 void handle_event(const eden::election_event_schedule& event)
 {
-   db.status.modify(get_status(), [&](auto& status) {
+   db->status.modify_fields(get_status(), [&](auto& status) {
       status.status.nextElection = event.election_time;
       status.status.electionThreshold = event.election_threshold;
    });
-   for (auto& member : db.members)
-   {
-      db.members.modify(member, [&](auto& member) { member.member.participating = false; });
-   }
+   clear_participating_flags();
 }
 
 void handle_event(const eden::election_event_begin& event)
 {
-   db.elections.emplace([&](auto& election) { election.time = event.election_time; });
+   db->elections.emplace([&](auto& election) { election.time = event.election_time; });
 }
 
 void handle_event(const eden::election_event_seeding& event)
 {
-   modify<by_pk>(db.elections, event.election_time, [&](auto& election) {
+   modify<by_pk>(db->elections, event.election_time, [&](auto& election) {
       election.seeding = true;
       election.seeding_start_time = event.start_time;
       election.seeding_end_time = event.end_time;
@@ -1903,7 +2570,7 @@ void handle_event(const eden::election_event_seeding& event)
 
 void handle_event(const eden::election_event_end_seeding& event)
 {
-   modify<by_pk>(db.elections, event.election_time, [&](auto& election) {
+   modify<by_pk>(db->elections, event.election_time, [&](auto& election) {
       election.seeding = false;
       election.seeding_start_time = std::nullopt;
       election.seeding_end_time = std::nullopt;
@@ -1912,7 +2579,7 @@ void handle_event(const eden::election_event_end_seeding& event)
 
 void handle_event(const eden::election_event_config_summary& event)
 {
-   modify<by_pk>(db.elections, event.election_time, [&](auto& election) {
+   modify<by_pk>(db->elections, event.election_time, [&](auto& election) {
       election.num_rounds = event.num_rounds;
       election.num_participants = event.num_participants;
    });
@@ -1920,7 +2587,7 @@ void handle_event(const eden::election_event_config_summary& event)
 
 void handle_event(const eden::election_event_create_round& event)
 {
-   db.election_rounds.emplace([&](auto& round) {
+   db->election_rounds.emplace([&](auto& round) {
       round.election_time = event.election_time;
       round.round = event.round;
       round.num_participants = event.num_participants;
@@ -1932,14 +2599,14 @@ void handle_event(const eden::election_event_create_round& event)
 void handle_event(const eden::election_event_create_group& event)
 {
    eosio::check(!event.voters.empty(), "group has no voters");
-   auto& group = db.election_groups.emplace([&](auto& group) {
+   auto& group = db->election_groups.emplace([&](auto& group) {
       group.election_time = event.election_time;
       group.round = event.round;
       group.first_member = *std::min_element(event.voters.begin(), event.voters.end());
    });
    for (auto voter : event.voters)
    {
-      db.votes.emplace([&](auto& vote) {
+      db->votes.emplace([&](auto& vote) {
          vote.election_time = group.election_time;
          vote.round = event.round;
          vote.group_id = group.id._id;
@@ -1950,7 +2617,7 @@ void handle_event(const eden::election_event_create_group& event)
 
 void handle_event(const eden::election_event_begin_round_voting& event)
 {
-   modify<by_round>(db.election_rounds, ElectionRoundKey{event.election_time, event.round},
+   modify<by_round>(db->election_rounds, ElectionRoundKey{event.election_time, event.round},
                     [&](auto& round) {
                        round.groups_available = true;
                        round.voting_started = true;
@@ -1961,7 +2628,7 @@ void handle_event(const eden::election_event_begin_round_voting& event)
 
 void handle_event(const eden::election_event_end_round_voting& event)
 {
-   modify<by_round>(db.election_rounds, ElectionRoundKey{event.election_time, event.round},
+   modify<by_round>(db->election_rounds, ElectionRoundKey{event.election_time, event.round},
                     [&](auto& round) { round.voting_finished = true; });
 }
 
@@ -1972,29 +2639,29 @@ void handle_event(const eden::election_event_report_group& event)
        std::min_element(event.votes.begin(), event.votes.end(), [](auto& a, auto& b) {
           return a.voter < b.voter;
        })->voter;
-   auto& group = get<by_pk>(db.election_groups,
+   auto& group = get<by_pk>(db->election_groups,
                             ElectionGroupKey{event.election_time, event.round, first_member});
-   db.election_groups.modify(group, [&](auto& group) { group.winner = event.winner; });
+   db->election_groups.modify(group, [&](auto& group) { group.winner = event.winner; });
    for (auto& v : event.votes)
    {
-      auto& vote = get<by_pk>(db.votes, std::tuple{v.voter, event.election_time, event.round});
-      db.votes.modify(vote, [&](auto& vote) { vote.candidate = v.candidate; });
+      auto& vote = get<by_pk>(db->votes, std::tuple{v.voter, event.election_time, event.round});
+      set_vote_candidate(vote, v.candidate);
    }
 }
 
 void handle_event(const eden::election_event_end_round& event)
 {
-   modify<by_round>(db.election_rounds, ElectionRoundKey{event.election_time, event.round},
+   modify<by_round>(db->election_rounds, ElectionRoundKey{event.election_time, event.round},
                     [&](auto& round) { round.results_available = true; });
 }
 
 void handle_event(const eden::election_event_end& event)
 {
-   modify<by_pk>(db.elections, event.election_time, [&](auto& election) {
+   modify<by_pk>(db->elections, event.election_time, [&](auto& election) {
       election.results_available = true;
       if (!election.num_rounds)
          return;
-      auto& idx = db.election_groups.get<by_pk>();
+      auto& idx = db->election_groups.get<by_pk>();
       auto it =
           idx.lower_bound(ElectionGroupKey{event.election_time, *election.num_rounds - 1, ""_n});
       if (it != idx.end() && it->election_time == event.election_time &&
@@ -2006,12 +2673,12 @@ void handle_event(const eden::election_event_end& event)
 
 void handle_event(const eden::distribution_event_schedule& event)
 {
-   db.distributions.emplace([&](auto& dist) { dist.time = event.distribution_time; });
+   db->distributions.emplace([&](auto& dist) { dist.time = event.distribution_time; });
 }
 
 void handle_event(const action_context& context, const eden::distribution_event_reserve& event)
 {
-   modify<by_pk>(db.distributions, event.distribution_time, [&](auto& dist) {
+   modify<by_pk>(db->distributions, event.distribution_time, [&](auto& dist) {
       transfer_funds(context.block.timestamp, pool_account(event.pool), distribution_fund,
                      event.target_amount, history_desc::reserve_distribution);
       dist.target_amount = event.target_amount;
@@ -2020,7 +2687,7 @@ void handle_event(const action_context& context, const eden::distribution_event_
 
 void handle_event(const eden::distribution_event_begin& event)
 {
-   modify<by_pk>(db.distributions, event.distribution_time, [&](auto& dist) {
+   modify<by_pk>(db->distributions, event.distribution_time, [&](auto& dist) {
       dist.started = true;
       dist.target_rank_distribution = event.rank_distribution;
    });
@@ -2037,14 +2704,14 @@ void handle_event(const action_context& context, const eden::distribution_event_
 {
    transfer_funds(context.block.timestamp, distribution_fund, pool_account(event.pool),
                   event.amount, history_desc::return_distribution);
-   modify<by_pk>(db.distribution_funds,
+   modify<by_pk>(db->distribution_funds,
                  distribution_fund_key{event.owner, event.distribution_time, event.rank},
                  [&](auto& fund) { fund.current_balance -= event.amount; });
 }
 
 void handle_event(const eden::distribution_event_fund& event)
 {
-   db.distribution_funds.emplace([&](auto& fund) {
+   db->distribution_funds.emplace([&](auto& fund) {
       fund.owner = event.owner;
       fund.distribution_time = event.distribution_time;
       fund.rank = event.rank;
@@ -2055,7 +2722,7 @@ void handle_event(const eden::distribution_event_fund& event)
 
 void handle_event(const eden::session_new_event& event)
 {
-   db.sessions.emplace([&](auto& session) {
+   db->sessions.emplace([&](auto& session) {
       session.eden_account = event.eden_account;
       session.key = event.key;
       session.expiration = event.expiration;
@@ -2065,7 +2732,7 @@ void handle_event(const eden::session_new_event& event)
 
 void handle_event(const eden::session_del_event& event)
 {
-   remove_if_exists<by_pk>(db.sessions, SessionKey{event.eden_account, event.key});
+   remove_if_exists<by_pk>(db->sessions, SessionKey{event.eden_account, event.key});
 }
 
 void handle_event(const auto& event) {}
@@ -2100,40 +2767,197 @@ void call(void (*f)(const action_context&, Args...),
    std::apply([&](auto&&... args) { f(context, std::move(args)...); }, t);
 }
 
+// Inductions expire induction_expiration_secs after createdAt, so by_createdAt also orders
+// them by expiration. This uses the contract's test (inductions::is_valid_induction), which
+// truncates the age to whole seconds; an induction is still usable until that exceeds the limit.
 void remove_expired_inductions(const eosio::time_point& block_time, const status& status)
 {
-   if (status.isMigrationCompleted<eden::fix_inductdonate_expiration_check>())
-      return;  // skip if migration is not ready to collect expired records
+   if (!status.isMigrationCompleted<eden::fix_inductdonate_expiration_check>())
+      return;  // inductdonate still accepted expired inductions before this migration
 
-   auto expiration_time = block_time.sec_since_epoch() - eden::induction_expiration_secs;
+   auto& index = db->inductions.get<by_createdAt>();
+   for (auto it = index.begin();
+        it != index.end() && (block_time - it->induction.createdAt.to_time_point()).to_seconds() >
+                                 eden::induction_expiration_secs;)
+   {
+      auto next = std::next(it);
+      db->inductions.remove(*it);
+      it = next;
+   }
+}
+
+// The contract drops sessions lazily; they're unusable once block time reaches expiration
+void remove_expired_sessions(const eosio::time_point& block_time)
+{
+   auto& index = db->sessions.get<by_expiration>();
+   eosio::block_timestamp now{block_time};
+   for (auto it = index.begin(); it != index.end() && it->expiration <= now;)
+   {
+      auto next = std::next(it);
+      db->sessions.remove(*it);
+      it = next;
+   }
+}
+
+// Raw balance history is kept for this many days. Older days are folded into daily rollups.
+// 0 keeps all of it.
+uint32_t history_retention_days = 0;
+
+constexpr uint32_t slots_per_day =
+    24 * 60 * 60 * 1000 / eosio::block_timestamp::block_interval_ms;
+
+// block_timestamp's epoch starts a day
+eosio::block_timestamp start_of_day(eosio::block_timestamp time)
+{
+   return eosio::block_timestamp{time.slot - time.slot % slots_per_day};
+}
 
-   auto& index = db.inductions.get<by_createdAt>();
-   auto it = index.begin();
+// balance_history's ids follow block time, so the oldest rows come first by id. Rows are
+// folded in that order, so the last one of each day sets the rollup's closing balance.
+void roll_up_balance_history(const eosio::time_point& block_time)
+{
+   uint64_t retention = uint64_t(history_retention_days) * slots_per_day;
+   auto today = start_of_day(eosio::block_timestamp{block_time});
+   if (!retention || today.slot < retention)
+      return;
 
-   while (it != index.end() &&
-          it->induction.createdAt.to_time_point().sec_since_epoch() < expiration_time)
+   eosio::block_timestamp oldest_raw_day{uint32_t(today.slot - retention)};
+   auto& index = db->balance_history.get<by_id>();
+   for (auto it = index.begin(); it != index.end() && it->time < oldest_raw_day;)
    {
-      auto next = it;
-      ++next;
-      db.inductions.remove(*it);
+      auto next = std::next(it);
+      auto day = start_of_day(it->time);
+      add_or_modify<by_pk>(db->balance_rollups, balance_history_key{it->account, day, 0},
+                           [&](bool is_new, auto& rollup) {
+                              if (is_new)
+                              {
+                                 rollup.account = it->account;
+                                 rollup.day = day;
+                                 rollup.delta = it->delta;
+                              }
+                              else
+                                 rollup.delta += it->delta;
+                              rollup.new_amount = it->new_amount;
+                           });
+      db->balance_history.remove(*it);
       it = next;
    }
 }
 
+// Runs once per block, before its transactions, inside the block's undo session
 void clean_data(const subchain::eosio_block& block)
 {
-   auto& idx = db.status.get<by_id>();
+   remove_expired_sessions(block.timestamp);
+   roll_up_balance_history(block.timestamp);
+
+   auto& idx = db->status.get<by_id>();
    if (idx.size() < 1)
       return;  // skip if genesis is not complete
 
    const auto& status = get_status();
    if (!status.status.active)
-      return;  // skip if contract is not active
+      return;  // genesis inductions don't expire
+
+   remove_expired_inductions(block.timestamp, status.status);
+}
+
+void run(const action_context& context, eosio::input_stream& s);
+
+using action_handler = void (*)(const action_context& context, eosio::input_stream& s);
+
+struct action_registration
+{
+   eosio::name name;
+   action_handler handler;
+};
+
+// Actions which the micro-chain handles, but which EDEN_ACTIONS doesn't declare: older
+// versions of the contract had transfer, and the session actions are commented out there.
+constexpr std::array extra_actions{
+    eden::action_info{"run"_n},
+    eden::action_info{"delsession"_n},
+    eden::action_info{"transfer"_n},
+};
 
-   // remove_expired_inductions(block.timestamp, status.status);
+// Handlers of eden actions, registered against eden::actions::action_table (plus
+// extra_actions). Actions without a handler are ignored.
+constexpr action_registration action_registrations[] = {
+    {"run"_n, run},
+    {"clearall"_n, [](auto& context, auto& s) { call(clearall, context, s); }},
+    {"delsession"_n, [](auto& context, auto& s) { call(delsession, context, s); }},
+    {"withdraw"_n, [](auto& context, auto& s) { call(withdraw, context, s); }},
+    {"donate"_n, [](auto& context, auto& s) { call(donate, context, s); }},
+    {"transfer"_n, [](auto& context, auto& s) { call(transfer, context, s); }},
+    {"fundtransfer"_n, [](auto& context, auto& s) { call(fundtransfer, context, s); }},
+    {"usertransfer"_n, [](auto& context, auto& s) { call(usertransfer, context, s); }},
+    {"genesis"_n, [](auto& context, auto& s) { call(genesis, context, s); }},
+    {"addtogenesis"_n, [](auto& context, auto& s) { call(addtogenesis, context, s); }},
+    {"inductinit"_n, [](auto& context, auto& s) { call(inductinit, context, s); }},
+    {"inductprofil"_n, [](auto& context, auto& s) { call(inductprofil, context, s); }},
+    {"inductmeetin"_n, [](auto& context, auto& s) { call(inductmeetin, context, s); }},
+    {"inductvideo"_n, [](auto& context, auto& s) { call(inductvideo, context, s); }},
+    {"inductcancel"_n, [](auto& context, auto& s) { call(inductcancel, context, s); }},
+    {"inductdonate"_n, [](auto& context, auto& s) { call(inductdonate, context, s); }},
+    {"inductendors"_n, [](auto& context, auto& s) { call(inductendors, context, s); }},
+    {"resign"_n, [](auto& context, auto& s) { call(resign, context, s); }},
+    {"rename"_n, [](auto& context, auto& s) { call(rename, context, s); }},
+    {"electopt"_n, [](auto& context, auto& s) { call(electopt, context, s); }},
+    {"electvote"_n, [](auto& context, auto& s) { call(electvote, context, s); }},
+    {"electmeeting"_n, [](auto& context, auto& s) { call(electmeeting, context, s); }},
+    {"electvideo"_n, [](auto& context, auto& s) { call(electvideo, context, s); }},
+    {"setencpubkey"_n, [](auto& context, auto& s) { call(setencpubkey, context, s); }},
+};
+
+constexpr auto micro_chain_actions = [] {
+   using eden::actions::action_table;
+   std::array<eden::action_info, action_table.size() + extra_actions.size()> result{};
+   std::size_t n = 0;
+   for (auto& action : action_table)
+      result[n++] = action;
+   for (auto& action : extra_actions)
+      result[n++] = action;
+   return result;
+}();
+constexpr eden::action_lookup micro_chain_action_index{micro_chain_actions};
+
+// Indexed like micro_chain_actions
+constexpr auto action_handlers = [] {
+   std::array<action_handler, micro_chain_actions.size()> result{};
+   for (auto& registration : action_registrations)
+      if (auto i = micro_chain_action_index.find(registration.name);
+          i != micro_chain_action_index.not_found)
+         result[i] = registration.handler;
+   return result;
+}();
+
+constexpr bool all_registrations_declared()
+{
+   for (auto& registration : action_registrations)
+      if (micro_chain_action_index.find(registration.name) == micro_chain_action_index.not_found)
+         return false;
+   return true;
 }
+static_assert(all_registrations_declared(),
+              "handler registered for an action which the contract doesn't declare");
 
-bool dispatch(eosio::name action_name, const action_context& context, eosio::input_stream& s);
+constexpr bool extra_actions_undeclared()
+{
+   for (auto& action : extra_actions)
+      if (eden::actions::action_index.find(action.name) != eden::actions::action_index.not_found)
+         return false;
+   return true;
+}
+static_assert(extra_actions_undeclared(), "EDEN_ACTIONS now declares an action in extra_actions");
+
+constexpr bool all_verbs_handled()
+{
+   for (auto& action : micro_chain_actions)
+      if (action.verb_index != eden::no_verb_index &&
+          !action_handlers[micro_chain_action_index.find(action.name)])
+         return false;
+   return true;
+}
+static_assert(all_verbs_handled(), "session verb without a handler; run can't skip verbs");
 
 void run(const action_context& context, eosio::input_stream& s)
 {
@@ -2144,72 +2968,29 @@ void run(const action_context& context, eosio::input_stream& s)
    for (uint32_t i = 0; i < num_verbs.value; ++i)
    {
       auto index = eosio::varuint32_from_bin(s);
-      auto name = eden::actions::get_name_for_session_action(index);
-      if (!dispatch(name, context, s))
+      auto action = micro_chain_action_index.find_verb(index);
+      if (action == micro_chain_action_index.not_found)
          // fatal because this throws off the rest of the stream
-         eosio::check(false,
-                      "run: verb not found: " + std::to_string(index) + " " + name.to_string());
+         eosio::check(false, "run: verb not found: " + std::to_string(index));
+      action_handlers[action](context, s);
    }
    eosio::check(!s.remaining(), "unpack error (extra data) within run");
 }
 
 bool dispatch(eosio::name action_name, const action_context& context, eosio::input_stream& s)
 {
-   if (action_name == "run"_n)
-      run(context, s);
-   else if (action_name == "clearall"_n)
-      call(clearall, context, s);
-   else if (action_name == "delsession"_n)
-      call(delsession, context, s);
-   else if (action_name == "withdraw"_n)
-      call(withdraw, context, s);
-   else if (action_name == "donate"_n)
-      call(donate, context, s);
-   else if (action_name == "transfer"_n)
-      call(transfer, context, s);
-   else if (action_name == "fundtransfer"_n)
-      call(fundtransfer, context, s);
-   else if (action_name == "usertransfer"_n)
-      call(usertransfer, context, s);
-   else if (action_name == "genesis"_n)
-      call(genesis, context, s);
-   else if (action_name == "addtogenesis"_n)
-      call(addtogenesis, context, s);
-   else if (action_name == "inductinit"_n)
-      call(inductinit, context, s);
-   else if (action_name == "inductprofil"_n)
-      call(inductprofil, context, s);
-   else if (action_name == "inductmeetin"_n)
-      call(inductmeetin, context, s);
-   else if (action_name == "inductvideo"_n)
-      call(inductvideo, context, s);
-   else if (action_name == "inductcancel"_n)
-      call(inductcancel, context, s);
-   else if (action_name == "inductdonate"_n)
-      call(inductdonate, context, s);
-   else if (action_name == "inductendors"_n)
-      call(inductendors, context, s);
-   else if (action_name == "resign"_n)
-      call(resign, context, s);
-   else if (action_name == "rename"_n)
-      call(rename, context, s);
-   else if (action_name == "electopt"_n)
-      call(electopt, context, s);
-   else if (action_name == "electvote"_n)
-      call(electvote, context, s);
-   else if (action_name == "electmeeting"_n)
-      call(electmeeting, context, s);
-   else if (action_name == "electvideo"_n)
-      call(electvideo, context, s);
-   else if (action_name == "setencpubkey"_n)
-      call(setencpubkey, context, s);
-   else
+   auto action = micro_chain_action_index.find(action_name);
+   if (action == micro_chain_action_index.not_found || !action_handlers[action])
       return false;
+   action_handlers[action](context, s);
    return true;
 }
 
 void filter_block(const subchain::eosio_block& block)
 {
+   // garbage collection housekeeping
+   clean_data(block);
+
    block_state block_state{};
    for (auto& trx : block.transactions)
    {
@@ -2245,14 +3026,29 @@ void filter_block(const subchain::eosio_block& block)
          }
       }  // for(action)
 
-      // garbage collection housekeeping
-      clean_data(block);
-
       eosio::check(!block_state.in_withdraw && !block_state.in_manual_transfer,
                    "missing transfer notification");
    }  // for(trx)
 }  // filter_block
 
+// Matches the actions which filter_block handles. Anything else is dropped before it's copied
+// into the subchain block.
+bool is_eden_action(eosio::name first_receiver,
+                    eosio::name receiver,
+                    eosio::name name,
+                    const std::optional<subchain::creator_action>& creator_action)
+{
+   if (first_receiver == eden_account)
+      return true;
+   if (first_receiver == token_account)
+      return receiver == eden_account && name == "transfer"_n;
+   if (first_receiver == "eosio.null"_n)
+      return name == "eden.events"_n && creator_action && creator_action->receiver == eden_account;
+   if (first_receiver == atomic_account)
+      return receiver == eden_account && (name == "logmint"_n || name == "logtransfer"_n);
+   return false;
+}
+
 std::vector<subchain::transaction> ship_to_eden_transactions(
     std::vector<eosio::ship_protocol::transaction_trace>& traces)
 {
@@ -2287,6 +3083,10 @@ std::vector<subchain::transaction> ship_to_eden_transactions(
                               trx_trace.action_traces[act_trace.creator_action_ordinal.value - 1]);
                        }
 
+                       if (!is_eden_action(act_trace.act.account, act_trace.receiver,
+                                           act_trace.act.name, creatorAction))
+                          return;
+
                        std::vector<char> data(act_trace.act.data.pos, act_trace.act.data.end);
                        eosio::bytes hexData{data};
 
@@ -2308,7 +3108,8 @@ std::vector<subchain::transaction> ship_to_eden_transactions(
                     action_trace);
              }
 
-             transactions.push_back(std::move(transaction));
+             if (!transaction.actions.empty())
+                transactions.push_back(std::move(transaction));
           },
           transaction_trace);
    }
@@ -2318,34 +3119,427 @@ std::vector<subchain::transaction> ship_to_eden_transactions(
 
 subchain::block_log block_log;
 
+// Whether query threads are served from replicas (native only; see setQuerySnapshots)
+bool replicas_enabled = false;
+
+#ifdef __wasm__
+void record_replica_changes() {}
+void publish_replica() {}
+#else
+// Read-only copies of live_db and block_log which query threads read (querySnapshot) while
+// this thread applies blocks. There are two: queries use the published one while the other
+// catches up. Catching up only copies the rows which changed since that replica was last
+// published, as recorded from the blocks' undo sessions, so it costs about as much as the
+// changes. If queries which started on that replica before the last publish are still
+// running, it skips its turn instead; the changes keep accumulating until the next one.
+//
+// Memory: while enabled, the process holds three full copies of the rows (live_db and both
+// replicas), without undo stacks; the replicas' block logs share blocks with block_log. Two
+// replicas is the fewest which keeps blocks and queries from waiting on each other; a slow
+// query only delays the next publish. A single replica
+// updated in place would make every block wait for queries. The rows are small next to the
+// blocks, and this is opt-in: disabling it empties the replicas. The box isn't affected; it
+// runs the wasm build, which has no replicas.
+struct replica
+{
+   database db;
+   subchain::block_log block_log;
+   std::vector<std::vector<int64_t>> changed_ids;  // in database::for_each_table order
+   bool copy_all = true;
+   std::atomic<uint32_t> num_readers = 0;
+};
+
+replica replicas[2];
+std::atomic<replica*> published_replica = nullptr;
+
+// Records the rows which the undo session on top of the stack changed. Must be called after
+// a block's session is pushed and before a session is undone.
+void record_replica_changes()
+{
+   if (!replicas_enabled)
+      return;
+   size_t i = 0;
+   database::for_each_table([&](auto table) {
+      auto changes = (live_db.*table).last_undo_session();
+      for (auto& r : replicas)
+      {
+         if (r.changed_ids.size() <= i)
+            r.changed_ids.resize(i + 1);
+         auto& ids = r.changed_ids[i];
+         for (auto& obj : changes.new_values)
+            ids.push_back(obj.id._id);
+         for (auto& obj : changes.old_values)
+            ids.push_back(obj.id._id);
+         for (auto& obj : changes.old_fields)
+            ids.push_back(obj.id._id);
+         for (auto& obj : changes.removed_values)
+            ids.push_back(obj.id._id);
+      }
+      ++i;
+   });
+}
+
+void remove_all_rows(auto& table)
+{
+   while (!table.empty())
+      table.remove(*table.begin());
+}
+
+template <typename Table>
+void copy_changed_rows(Table& to, const Table& from, std::vector<int64_t>& ids)
+{
+   std::sort(ids.begin(), ids.end());
+   ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+   // Removing all of them before copying any back keeps rows which traded keys from
+   // conflicting
+   for (auto id : ids)
+      if (auto* obj = to.find(typename Table::id_type{id}))
+         to.remove(*obj);
+   for (auto id : ids)
+      if (auto* obj = from.find(typename Table::id_type{id}))
+         to.insert_copy(*obj);
+   ids.clear();
+}
+
+// Brings the unpublished replica up to date with live_db and block_log, then publishes it.
+// Does nothing if queries are still reading that replica.
+void publish_replica()
+{
+   if (!replicas_enabled)
+      return;
+   auto& r = published_replica.load() == &replicas[0] ? replicas[1] : replicas[0];
+   if (r.num_readers.load())
+      return;
+   size_t i = 0;
+   database::for_each_table([&](auto table) {
+      if (r.copy_all)
+      {
+         remove_all_rows(r.db.*table);
+         for (auto& obj : live_db.*table)
+            (r.db.*table).insert_copy(obj);
+      }
+      else if (i < r.changed_ids.size())
+         copy_changed_rows(r.db.*table, live_db.*table, r.changed_ids[i]);
+      ++i;
+   });
+   if (r.copy_all)
+      r.changed_ids.clear();
+   r.copy_all = false;
+   r.block_log.copy_from(block_log);
+   published_replica.store(&r);
+}
+
+// Wakes setQuerySnapshots, which waits for the last reader when disabling replicas
+void release_replica(replica* r)
+{
+   if (!--r->num_readers)
+      r->num_readers.notify_one();
+}
+
+// Returns the published replica, which stays valid until release_replica. Returns nullptr if
+// replicas are disabled.
+replica* acquire_replica()
+{
+   while (true)
+   {
+      auto* r = published_replica.load();
+      if (!r)
+         return nullptr;
+      ++r->num_readers;
+      // Otherwise publish_replica may have started updating r before counting this reader
+      if (r == published_replica.load())
+         return r;
+      release_replica(r);
+   }
+}
+#endif
+
 void forked_n_blocks(size_t n)
 {
    if (n)
       printf("forked %d blocks, %d now in log\n", (int)n, (int)block_log.blocks.size());
    while (n--)
-      db.db.undo();
+   {
+      record_replica_changes();
+      db->db.undo();
+   }
+}
+
+// Changes made by each block, for clients which follow the chain instead of polling it.
+// They're read from the block's undo session.
+//
+// Block deltas format, one record per applied block:
+//    uint32_t block num
+//    varuint32 num_tables
+//    for each table which changed, in database order:
+//       varuint32 type_id
+//       varuint32 num_created, for each: int64_t id, object fields
+//       varuint32 num_modified, for each: int64_t id, object fields after the block
+//       varuint32 num_removed, for each: int64_t id
+//
+// A record whose block num isn't greater than the previous record's replaces the blocks
+// from that num on; they were undone by a fork.
+bool record_deltas = false;
+std::vector<char> block_deltas;
+
+bool has_changes(const auto& changes)
+{
+   return !changes.new_values.empty() || !changes.old_values.empty() ||
+          !changes.removed_values.empty() || !changes.old_fields.empty();
+}
+
+// Objects which were modified, then removed, are only reported as removed
+template <typename Table>
+auto modified_objects(const Table& table, const auto& changes)
+{
+   std::vector<typename Table::id_type> ids;
+   for (auto& old : changes.old_values)
+      ids.push_back(old.id);
+   for (auto& old : changes.old_fields)
+      ids.push_back(old.id);
+   std::sort(ids.begin(), ids.end());
+   ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+   std::vector<const typename Table::value_type*> result;
+   for (auto id : ids)
+      if (auto* obj = table.find(id))
+         result.push_back(obj);
+   return result;
+}
+
+void write_table_delta(const auto& table, const auto& changes, auto& stream)
+{
+   using value_type = typename std::decay_t<decltype(table)>::value_type;
+   eosio::varuint32_to_bin(value_type::type_id, stream);
+   eosio::varuint32_to_bin(boost::size(changes.new_values), stream);
+   for (auto& obj : changes.new_values)
+   {
+      eosio::to_bin(obj.id._id, stream);
+      eosio::to_bin(obj, stream);
+   }
+   auto modified = modified_objects(table, changes);
+   eosio::varuint32_to_bin(modified.size(), stream);
+   for (auto* obj : modified)
+   {
+      eosio::to_bin(obj->id._id, stream);
+      eosio::to_bin(*obj, stream);
+   }
+   eosio::varuint32_to_bin(boost::size(changes.removed_values), stream);
+   for (auto& obj : changes.removed_values)
+      eosio::to_bin(obj.id._id, stream);
 }
 
-bool add_block(subchain::block_with_id&& bi, uint32_t eosio_irreversible)
+// The changes which the last block made to a table. The lists are only built if a query
+// selects them; finding which tables changed (see gql_changed_members) stays cheap.
+template <typename T, const char* Name, typename Table, typename ToNode>
+struct TableDelta
 {
-   auto [status, num_forked] = block_log.add_block(bi);
+   const Table* table;
+   ToNode to_node;
+
+   std::vector<T> created() const
+   {
+      std::vector<T> result;
+      for (auto& obj : table->last_undo_session().new_values)
+         result.push_back(to_node(obj));
+      return result;
+   }
+
+   // values after the block
+   std::vector<T> modified() const
+   {
+      std::vector<T> result;
+      for (auto* obj : modified_objects(*table, table->last_undo_session()))
+         result.push_back(to_node(*obj));
+      return result;
+   }
+
+   // values before the block
+   std::vector<T> removed() const
+   {
+      std::vector<T> result;
+      for (auto& obj : table->last_undo_session().removed_values)
+         result.push_back(to_node(obj));
+      return result;
+   }
+};
+template <typename T, const char* Name, typename Table, typename ToNode>
+[[maybe_unused]] inline const char* get_type_name(TableDelta<T, Name, Table, ToNode>*)
+{
+   return Name;
+}
+template <typename T, const char* Name, typename Table, typename ToNode, typename F>
+constexpr void eosio_for_each_field(TableDelta<T, Name, Table, ToNode>*, F f)
+{
+   using delta_type = TableDelta<T, Name, Table, ToNode>;
+   EOSIO_REFLECT2_FOR_EACH_FIELD(delta_type, created, modified, removed)
+}
+
+template <typename T, const char* Name, typename Table, typename ToNode>
+std::optional<TableDelta<T, Name, Table, ToNode>> make_table_delta(const Table& table,
+                                                                   ToNode to_node)
+{
+   if (!has_changes(table.last_undo_session()))
+      return std::nullopt;
+   return TableDelta<T, Name, Table, ToNode>{&table, to_node};
+}
+
+constexpr const char BalanceDelta_name[] = "BalanceDelta";
+constexpr const char BalanceHistoryDelta_name[] = "BalanceHistoryDelta";
+constexpr const char BalanceRollupDelta_name[] = "BalanceRollupDelta";
+constexpr const char EncryptionKeyDelta_name[] = "EncryptionKeyDelta";
+constexpr const char InductionDelta_name[] = "InductionDelta";
+constexpr const char MemberDelta_name[] = "MemberDelta";
+constexpr const char SessionDelta_name[] = "SessionDelta";
+constexpr const char ElectionDelta_name[] = "ElectionDelta";
+constexpr const char VoteDelta_name[] = "VoteDelta";
+constexpr const char DistributionDelta_name[] = "DistributionDelta";
+constexpr const char NftDelta_name[] = "NftDelta";
+
+// Root of subscriptions. Each table is null if the block didn't change it.
+struct BlockDeltas
+{
+   uint32_t blockNum;
+
+   auto balances() const
+   {
+      return make_table_delta<Balance, BalanceDelta_name>(
+          db->balances, [](auto& obj) { return Balance{obj.account, &obj}; });
+   }
+   auto balanceHistory() const
+   {
+      return make_table_delta<BalanceHistory, BalanceHistoryDelta_name>(
+          db->balance_history, [](auto& obj) { return BalanceHistory{&obj}; });
+   }
+   auto balanceRollups() const
+   {
+      return make_table_delta<BalanceHistory, BalanceRollupDelta_name>(
+          db->balance_rollups, [](auto& obj) { return BalanceHistory{nullptr, &obj}; });
+   }
+   auto encryptionKeys() const
+   {
+      return make_table_delta<EncryptionKey, EncryptionKeyDelta_name>(
+          db->encryption_keys, [](auto& obj) { return EncryptionKey{obj.account, &obj}; });
+   }
+   auto inductions() const
+   {
+      return make_table_delta<Induction, InductionDelta_name>(
+          db->inductions,
+          [](auto& obj) { return Induction{obj.induction.id, &obj.induction}; });
+   }
+   auto members() const
+   {
+      return make_table_delta<Member, MemberDelta_name>(
+          db->members, [](auto& obj) { return Member{obj.member.account, &obj.member}; });
+   }
+   auto sessions() const
+   {
+      return make_table_delta<Session, SessionDelta_name>(
+          db->sessions, [](auto& obj) { return Session{&obj}; });
+   }
+   auto elections() const
+   {
+      return make_table_delta<Election, ElectionDelta_name>(
+          db->elections, [](auto& obj) { return Election{&obj}; });
+   }
+   auto votes() const
+   {
+      return make_table_delta<Vote, VoteDelta_name>(
+          db->votes, [](auto& obj) { return Vote{&obj}; });
+   }
+   auto distributions() const
+   {
+      return make_table_delta<Distribution, DistributionDelta_name>(
+          db->distributions, [](auto& obj) { return Distribution{&obj}; });
+   }
+   auto nfts() const
+   {
+      return make_table_delta<Nft, NftDelta_name>(
+          db->nfts, [](auto& obj) { return Nft{&obj}; });
+   }
+};
+EOSIO_REFLECT2(BlockDeltas,
+               blockNum,
+               balances,
+               balanceHistory,
+               balanceRollups,
+               encryptionKeys,
+               inductions,
+               members,
+               sessions,
+               elections,
+               votes,
+               distributions,
+               nfts)
+
+clchain::gql_subscriptions<BlockDeltas> subscriptions;
+std::string subscription_results;  // comma-separated JSON objects
+
+// Must be called while the block's undo session is on top of the undo stack
+void record_block_deltas(uint32_t block_num)
+{
+   record_replica_changes();
+   if (record_deltas)
+   {
+      eosio::vector_stream stream{block_deltas};
+      eosio::to_bin(block_num, stream);
+      uint32_t num_tables = 0;
+      db->for_each_index(
+          [&](auto& table) { num_tables += has_changes(table.last_undo_session()); });
+      eosio::varuint32_to_bin(num_tables, stream);
+      db->for_each_index([&](auto& table) {
+         auto changes = table.last_undo_session();
+         if (has_changes(changes))
+            write_table_delta(table, changes, stream);
+      });
+   }
+   query_scope scope;
+   subscriptions.publish(BlockDeltas{block_num}, [&](uint32_t id, const std::string& data) {
+      if (!subscription_results.empty())
+         subscription_results += ',';
+      subscription_results += "{\"id\":" + std::to_string(id) +
+                              ",\"block\":" + std::to_string(block_num) + ",\"result\":" + data +
+                              "}";
+   });
+}
+
+void apply_block(const subchain::block_with_id& bi)
+{
+   bool need_undo = bi.num > block_log.irreversible;
+   bool need_deltas = record_deltas || !subscriptions.empty() || replicas_enabled;
+   auto session = db->db.start_undo_session(need_undo || need_deltas);
+   filter_block(bi.eosioBlock);
+   session.push();
+   if (need_deltas)
+      record_block_deltas(bi.num);
+   if (!need_undo)
+   {
+      if (need_deltas)
+         db->db.commit(db->db.revision());
+      db->db.set_revision(bi.num);
+   }
+}
+
+// bin is bi's serialized form, if the caller already has it
+bool add_block(subchain::block_with_id&& bi,
+               uint32_t eosio_irreversible,
+               std::vector<char> bin = {})
+{
+   auto [status, num_forked] = block_log.add_block(bi, std::move(bin));
    if (status)
       return false;
    forked_n_blocks(num_forked);
    if (auto* b = block_log.block_before_eosio_num(eosio_irreversible + 1))
       block_log.irreversible = std::max(block_log.irreversible, b->num);
-   db.db.commit(block_log.irreversible);
-   bool need_undo = bi.num > block_log.irreversible;
-   auto session = db.db.start_undo_session(bi.num > block_log.irreversible);
-   filter_block(bi.eosioBlock);
-   session.push();
-   if (!need_undo)
-      db.db.set_revision(bi.num);
+   db->db.commit(block_log.irreversible);
+   apply_block(bi);
+   if (block_log.archive)
+      block_log.trim();
+   publish_replica();
    // printf("%s block: %d %d log: %d irreversible: %d db: %d-%d %s\n", block_log.status_str[status],
    //        (int)bi.eosioBlock.num, (int)bi.num, (int)block_log.blocks.size(),
    //        block_log.irreversible,  //
-   //        (int)db.db.undo_stack_revision_range().first,
-   //        (int)db.db.undo_stack_revision_range().second,  //
+   //        (int)db->db.undo_stack_revision_range().first,
+   //        (int)db->db.undo_stack_revision_range().second,  //
    //        to_string(bi.eosioBlock.id).c_str());
    return true;
 }
@@ -2358,8 +3552,8 @@ bool add_block(subchain::block&& eden_block, uint32_t eosio_irreversible)
    bi.id = clchain::sha256(bin.data(), bin.size());
    auto bin_with_id = eosio::convert_to_bin(bi.id);
    bin_with_id.insert(bin_with_id.end(), bin.begin(), bin.end());
-   result = std::move(bin_with_id);
-   return add_block(std::move(bi), eosio_irreversible);
+   result = bin_with_id;
+   return add_block(std::move(bi), eosio_irreversible, std::move(bin_with_id));
 }
 
 bool add_block(subchain::eosio_block&& eosioBlock, uint32_t eosio_irreversible)
@@ -2395,9 +3589,9 @@ bool add_block(eosio::ship_protocol::block_position block,
 }
 
 // TODO: prevent from_json from aborting
-[[clang::export_name("addEosioBlockJson")]] bool addEosioBlockJson(const char* json,
-                                                                   uint32_t size,
-                                                                   uint32_t eosio_irreversible)
+MICRO_CHAIN_EXPORT(addEosioBlockJson) bool addEosioBlockJson(const char* json,
+                                                             uint32_t size,
+                                                             uint32_t eosio_irreversible)
 {
    std::string str(json, size);
    eosio::json_token_stream s(str.data());
@@ -2411,18 +3605,18 @@ bool add_block(eosio::ship_protocol::block_position block,
 }
 
 // TODO: prevent from_bin from aborting
-[[clang::export_name("addBlock")]] bool addBlock(const char* data,
-                                                 uint32_t size,
-                                                 uint32_t eosio_irreversible)
+MICRO_CHAIN_EXPORT(addBlock) bool addBlock(const char* data,
+                                           uint32_t size,
+                                           uint32_t eosio_irreversible)
 {
    // TODO: verify id integrity
    eosio::input_stream bin{data, size};
    subchain::block_with_id block;
    eosio::from_bin(block, bin);
-   return add_block(std::move(block), eosio_irreversible);
+   return add_block(std::move(block), eosio_irreversible, std::vector<char>(data, bin.pos));
 }
 
-[[clang::export_name("getShipBlocksRequest")]] bool getShipBlocksRequest(uint32_t block_num)
+MICRO_CHAIN_EXPORT(getShipBlocksRequest) bool getShipBlocksRequest(uint32_t block_num)
 {
    eosio::ship_protocol::request request = eosio::ship_protocol::get_blocks_request_v0{
        .start_block_num = block_num,
@@ -2436,9 +3630,8 @@ bool add_block(eosio::ship_protocol::block_position block,
    return true;
 }
 
-[[clang::export_name("pushShipMessage")]] bool pushShipMessage(const char* data, uint32_t size)
+bool push_ship_message(eosio::input_stream bin)
 {
-   eosio::input_stream bin{data, size};
    eosio::ship_protocol::result result;
    eosio::from_bin(result, bin);
 
@@ -2465,39 +3658,300 @@ bool add_block(eosio::ship_protocol::block_position block,
    return false;
 }
 
-[[clang::export_name("setIrreversible")]] uint32_t setIrreversible(uint32_t irreversible)
+// TODO: prevent from_bin from aborting
+MICRO_CHAIN_EXPORT(pushShipMessage) bool pushShipMessage(const char* data, uint32_t size)
+{
+   return push_ship_message({data, size});
+}
+
+// Pushes count messages, each prefixed by a varuint32 length. Blocks which are already
+// irreversible are applied without undo sessions, so a batch mostly saves the host/wasm
+// round trips. result holds one byte per message: 1 if it added a block, 0 otherwise.
+// TODO: prevent from_bin from aborting
+MICRO_CHAIN_EXPORT(pushShipMessages) uint32_t pushShipMessages(const char* data,
+                                                               uint32_t size,
+                                                               uint32_t count)
+{
+   eosio::input_stream bin{data, size};
+   std::vector<char> statuses;
+   statuses.reserve(count);
+   uint32_t num_added = 0;
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      auto message_size = eosio::varuint32_from_bin(bin);
+      eosio::check(message_size <= bin.remaining(), "ship message batch is truncated");
+      bool added = push_ship_message({bin.pos, message_size});
+      bin.skip(message_size);
+      statuses.push_back(added);
+      num_added += added;
+   }
+   eosio::check(!bin.remaining(), "unpack error (extra data) within ship message batch");
+   result = std::move(statuses);
+   return num_added;
+}
+
+MICRO_CHAIN_EXPORT(setIrreversible) uint32_t setIrreversible(uint32_t irreversible)
 {
    if (auto* b = block_log.block_before_num(irreversible + 1))
       block_log.irreversible = std::max(block_log.irreversible, b->num);
-   db.db.commit(block_log.irreversible);
+   db->db.commit(block_log.irreversible);
+   if (block_log.archive)
+      block_log.trim();
+   publish_replica();
    return block_log.irreversible;
 }
 
-[[clang::export_name("trimBlocks")]] void trimBlocks()
+// Takes effect from the next block. Days which were already rolled up stay rolled up.
+MICRO_CHAIN_EXPORT(setHistoryRetention) void setHistoryRetention(uint32_t days)
+{
+   history_retention_days = days;
+}
+
+MICRO_CHAIN_EXPORT(trimBlocks) void trimBlocks()
 {
    block_log.trim();
+   publish_replica();
 }
 
-[[clang::export_name("undoBlockNum")]] void undoBlockNum(uint32_t blockNum)
+MICRO_CHAIN_EXPORT(undoBlockNum) void undoBlockNum(uint32_t blockNum)
 {
    forked_n_blocks(block_log.undo(blockNum));
+   publish_replica();
 }
 
-[[clang::export_name("undoEosioNum")]] void undoEosioNum(uint32_t eosioNum)
+MICRO_CHAIN_EXPORT(undoEosioNum) void undoEosioNum(uint32_t eosioNum)
 {
    if (auto* b = block_log.block_by_eosio_num(eosioNum))
       forked_n_blocks(block_log.undo(b->num));
+   publish_replica();
+}
+
+MICRO_CHAIN_EXPORT(setRecordDeltas) void setRecordDeltas(bool enable)
+{
+   record_deltas = enable;
+   if (!enable)
+      block_deltas.clear();
+}
+
+// Returns the deltas recorded since the last call
+MICRO_CHAIN_EXPORT(getBlockDeltas) void getBlockDeltas()
+{
+   result = std::move(block_deltas);
+   block_deltas.clear();
+}
+
+// Returns the subscription's id, or 0 with an error in result
+MICRO_CHAIN_EXPORT(subscribe) uint32_t subscribe(const char* query,
+                                                 uint32_t size,
+                                                 const char* variables,
+                                                 uint32_t variables_size)
+{
+   std::string error;
+   auto id = subscriptions.subscribe({query, size}, {variables, variables_size},
+                                     [&](const auto& e) {
+                                        error = e;
+                                        return false;
+                                     });
+   if (!id)
+      result = clchain::gql_error_result<eosio::string_stream>(error);
+   return id;
+}
+
+MICRO_CHAIN_EXPORT(unsubscribe) bool unsubscribe(uint32_t id)
+{
+   return subscriptions.unsubscribe(id);
+}
+
+// Returns a JSON array of the results produced since the last call, each
+// {"id": subscription id, "block": block num, "result": query result}
+MICRO_CHAIN_EXPORT(getSubscriptionResults) void getSubscriptionResults()
+{
+   result = "[" + subscription_results + "]";
+   subscription_results.clear();
+}
+
+// Returns block num's serialized form, or nullptr if the log doesn't have it. Archived
+// blocks are read into archived.
+const std::vector<char>* find_block_bin(uint32_t num, std::vector<char>& archived)
+{
+   if (auto* block = block_log.block_by_num(num))
+      return &block->bin;
+   if (block_log.archive)
+      archived = block_log.archive->read(num);
+   return archived.empty() ? nullptr : &archived;
 }
 
-[[clang::export_name("getBlock")]] bool getBlock(uint32_t num)
+MICRO_CHAIN_EXPORT(getBlock) bool getBlock(uint32_t num)
 {
-   auto block = block_log.block_by_num(num);
-   if (!block)
+   std::vector<char> archived;
+   auto* bin = find_block_bin(num, archived);
+   if (!bin)
       return false;
-   result = eosio::convert_to_bin(*block);
+   if (bin == &archived)
+      result = std::move(archived);
+   else
+      result = *bin;
    return true;
 }
 
+// Returns blocks from through to in result, each as varuint32 size followed by the
+// serialized block_with_id. Stops early at a block the log doesn't have, or before exceeding
+// max_bytes, but always includes from if the log has it. Returns the number of blocks.
+MICRO_CHAIN_EXPORT(getBlocks) uint32_t getBlocks(uint32_t from, uint32_t to, uint32_t max_bytes)
+{
+   std::vector<char> blocks;
+   eosio::vector_stream stream{blocks};
+   uint32_t count = 0;
+   for (uint64_t num = from; num <= to; ++num)
+   {
+      std::vector<char> archived;
+      auto* bin = find_block_bin(num, archived);
+      if (!bin)
+         break;
+      eosio::size_stream size;
+      eosio::varuint32_to_bin(bin->size(), size);
+      if (count && blocks.size() + size.size + bin->size() > max_bytes)
+         break;
+      eosio::varuint32_to_bin(bin->size(), stream);
+      stream.write(bin->data(), bin->size());
+      ++count;
+   }
+   result = std::move(blocks);
+   return count;
+}
+
+#ifndef __wasm__
+// Irreversible blocks move to the file once they're applied, instead of staying in memory
+MICRO_CHAIN_EXPORT(openBlockFile) void openBlockFile(const char* path, uint32_t size)
+{
+   block_log.archive = std::make_shared<subchain::block_file>(std::string{path, size});
+   block_log.trim();
+   publish_replica();
+}
+#endif
+
+// Snapshot format:
+//    snapshot_header
+//    int64_t revision of the stored state
+//    for each table, in database order:
+//       varuint32 type_id, int64_t next_id, varuint32 num_rows
+//       for each row: varuint32 (id - previous id), object fields
+//    uint32_t irreversible
+//    varuint32 num_blocks, block_with_id...
+//
+// The stored state is at the oldest revision on the undo stack. Export reads it through the
+// tables' undo sessions, so it doesn't change the database. Blocks past that point are
+// replayed on import, which rebuilds their undo sessions.
+constexpr uint32_t snapshot_magic = 0x6e656465;  // "eden"
+constexpr uint32_t snapshot_version = 0;
+
+struct snapshot_header
+{
+   uint32_t magic = snapshot_magic;
+   uint32_t version = snapshot_version;
+};
+EOSIO_REFLECT(snapshot_header, magic, version)
+
+template <typename S>
+void write_snapshot_table(const auto& table, int64_t revision, S& stream)
+{
+   using value_type = typename std::decay_t<decltype(table)>::value_type;
+   eosio::varuint32_to_bin(value_type::type_id, stream);
+   eosio::to_bin(table.next_id_at_revision(revision)._id, stream);
+   uint32_t num_rows = 0;
+   table.for_each_at_revision(revision, [&](auto&) { ++num_rows; });
+   eosio::varuint32_to_bin(num_rows, stream);
+   int64_t prev_id = 0;
+   table.for_each_at_revision(revision, [&](auto& obj) {
+      eosio::varuint32_to_bin(obj.id._id - prev_id, stream);
+      eosio::to_bin(obj, stream);
+      prev_id = obj.id._id;
+   });
+}
+
+void read_snapshot_table(auto& table, eosio::input_stream& stream)
+{
+   using value_type = typename std::decay_t<decltype(table)>::value_type;
+   eosio::check(eosio::varuint32_from_bin(stream) == value_type::type_id,
+                "snapshot has mismatched tables");
+   int64_t next_id;
+   eosio::from_bin(next_id, stream);
+   auto num_rows = eosio::varuint32_from_bin(stream);
+   int64_t id = 0;
+   for (uint32_t i = 0; i < num_rows; ++i)
+   {
+      id += eosio::varuint32_from_bin(stream);
+      table.set_next_id(id);
+      table.emplace([&](auto& obj) { eosio::from_bin(obj, stream); });
+   }
+   table.set_next_id(next_id);
+}
+
+template <typename S>
+void write_snapshot(int64_t revision, S& stream)
+{
+   eosio::to_bin(snapshot_header{}, stream);
+   eosio::to_bin(revision, stream);
+   db->for_each_index([&](auto& table) { write_snapshot_table(table, revision, stream); });
+   eosio::to_bin(block_log.irreversible, stream);
+   eosio::varuint32_to_bin(block_log.blocks.size(), stream);
+   for (auto& block : block_log.blocks)
+      stream.write(block->bin.data(), block->bin.size());
+}
+
+MICRO_CHAIN_EXPORT(exportSnapshot) void exportSnapshot()
+{
+   auto revision = db->db.undo_stack_revision_range().first;
+   eosio::size_stream ss;
+   write_snapshot(revision, ss);
+   std::vector<char> bin(ss.size);
+   eosio::fixed_buf_stream fbs(bin.data(), bin.size());
+   write_snapshot(revision, fbs);
+   eosio::check(fbs.pos == fbs.end, eosio::convert_stream_error(eosio::stream_error::underrun));
+   result = std::move(bin);
+}
+
+// TODO: prevent from_bin from aborting
+MICRO_CHAIN_EXPORT(importSnapshot) void importSnapshot(const char* data, uint32_t size)
+{
+   eosio::check(db->status.empty() && block_log.blocks.empty(),
+                "importSnapshot requires an empty database");
+   eosio::input_stream bin{data, size};
+   snapshot_header header;
+   eosio::from_bin(header, bin);
+   eosio::check(header.magic == snapshot_magic, "not a snapshot");
+   eosio::check(header.version <= snapshot_version, "unsupported snapshot version");
+
+   int64_t revision;
+   eosio::from_bin(revision, bin);
+   db->for_each_index([&](auto& table) { read_snapshot_table(table, bin); });
+   for (auto& obj : db->members)
+      add_member_witnesses(obj.member);
+   for (auto& vote : db->votes)
+      if (vote.candidate.value)
+         add_vote_tally(vote.group_id, vote.candidate);
+   eosio::from_bin(block_log.irreversible, bin);
+   auto num_blocks = eosio::varuint32_from_bin(bin);
+   for (uint32_t i = 0; i < num_blocks; ++i)
+   {
+      auto begin = bin.pos;
+      auto block = std::make_shared<subchain::block_with_bin>();
+      eosio::from_bin(static_cast<subchain::block_with_id&>(*block), bin);
+      block->bin.assign(begin, bin.pos);
+      block_log.blocks.push_back(std::move(block));
+   }
+   eosio::check(!bin.remaining(), "unpack error (extra data) within snapshot");
+
+   db->db.set_revision(revision);
+   for (auto it = block_log.upper_bound_by_num(revision); it != block_log.blocks.end(); ++it)
+      apply_block(**it);
+#ifndef __wasm__
+   for (auto& r : replicas)
+      r.copy_all = true;
+#endif
+   publish_replica();
+}
+
 constexpr const char MemberConnection_name[] = "MemberConnection";
 constexpr const char MemberEdge_name[] = "MemberEdge";
 using MemberConnection =
@@ -2524,7 +3978,7 @@ struct Query
 
    std::optional<Status> status() const
    {
-      auto& idx = db.status.get<by_id>();
+      auto& idx = db->status.get<by_id>();
       if (idx.size() != 1)
          return std::nullopt;
       return Status{&idx.begin()->status};
@@ -2537,12 +3991,13 @@ struct Query
                               std::optional<uint32_t> first,
                               std::optional<uint32_t> last,
                               std::optional<std::string> before,
-                              std::optional<std::string> after) const
+                              std::optional<std::string> after,
+                              std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<BalanceConnection, eosio::name>(
-          gt, ge, lt, le, first, last, before, after,  //
-          db.balances.get<by_pk>(),                    //
-          [](auto& obj) { return obj.account; },       //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->balances.get<by_pk>(),                           //
+          [](auto& obj) { return obj.account; },               //
           [](auto& obj) {
              return Balance{obj.account, &obj};
           },
@@ -2560,12 +4015,13 @@ struct Query
                                           std::optional<uint32_t> first,
                                           std::optional<uint32_t> last,
                                           std::optional<std::string> before,
-                                          std::optional<std::string> after) const
+                                          std::optional<std::string> after,
+                                          std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<EncryptionKeyConnection, eosio::name>(
-          gt, ge, lt, le, first, last, before, after,  //
-          db.encryption_keys.get<by_pk>(),             //
-          [](auto& obj) { return obj.account; },       //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->encryption_keys.get<by_pk>(),                    //
+          [](auto& obj) { return obj.account; },               //
           [](auto& obj) {
              return EncryptionKey{obj.account, &obj};
           },
@@ -2580,12 +4036,41 @@ struct Query
                             std::optional<uint32_t> first,
                             std::optional<uint32_t> last,
                             std::optional<std::string> before,
-                            std::optional<std::string> after) const
+                            std::optional<std::string> after,
+                            std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<MemberConnection, eosio::name>(
-          gt, ge, lt, le, first, last, before, after,    //
-          db.members.get<by_pk>(),                       //
-          [](auto& obj) { return obj.member.account; },  //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->members.get<by_pk>(),                            //
+          [](auto& obj) { return obj.member.account; },        //
+          [](auto& obj) {
+             return Member{obj.member.account, &obj.member};
+          },
+          [](auto& members, auto key) { return members.lower_bound(key); },
+          [](auto& members, auto key) { return members.upper_bound(key); });
+   }
+
+   // Members who opted into the next election
+   MemberConnection participants(std::optional<eosio::name> gt,
+                                 std::optional<eosio::name> ge,
+                                 std::optional<eosio::name> lt,
+                                 std::optional<eosio::name> le,
+                                 std::optional<uint32_t> first,
+                                 std::optional<uint32_t> last,
+                                 std::optional<std::string> before,
+                                 std::optional<std::string> after,
+                                 std::optional<uint32_t> offset) const
+   {
+      using key = std::pair<bool, eosio::name>;
+      return clchain::make_connection<MemberConnection, key>(
+          gt ? std::optional{key{true, *gt}} : std::nullopt,                    //
+          ge ? std::optional{key{true, *ge}} : std::optional{key{true, ""_n}},  //
+          lt ? std::optional{key{true, *lt}} : std::nullopt,                    //
+          le ? std::optional{key{true, *le}}                                    //
+             : std::optional{key{true, eosio::name{~uint64_t(0)}}},             //
+          first, last, before, after, offset,                                   //
+          db->members.get<by_participating>(),                                  //
+          [](auto& obj) { return obj.by_participating(); },                     //
           [](auto& obj) {
              return Member{obj.member.account, &obj.member};
           },
@@ -2600,7 +4085,8 @@ struct Query
                                        std::optional<uint32_t> first,
                                        std::optional<uint32_t> last,
                                        std::optional<std::string> before,
-                                       std::optional<std::string> after) const
+                                       std::optional<std::string> after,
+                                       std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<MemberConnection, MemberCreatedAtKey>(
           gt ? std::optional{MemberCreatedAtKey{*gt, account_max}}  //
@@ -2611,8 +4097,8 @@ struct Query
              : std::nullopt,                                        //
           le ? std::optional{MemberCreatedAtKey{*le, account_max}}  //
              : std::nullopt,                                        //
-          first, last, before, after,                               //
-          db.members.get<by_createdAt>(),                           //
+          first, last, before, after, offset,                       //
+          db->members.get<by_createdAt>(),                          //
           [](auto& obj) { return obj.by_createdAt(); },             //
           [](auto& obj) {
              return Member{obj.member.account, &obj.member};
@@ -2628,7 +4114,8 @@ struct Query
                               std::optional<uint32_t> first,
                               std::optional<uint32_t> last,
                               std::optional<std::string> before,
-                              std::optional<std::string> after) const
+                              std::optional<std::string> after,
+                              std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<SessionConnection, SessionKey>(
           gt ? std::optional{SessionKey{*gt, public_key_max_r1}}  //
@@ -2639,8 +4126,8 @@ struct Query
              : std::nullopt,                                      //
           le ? std::optional{SessionKey{*le, public_key_max_r1}}  //
              : std::nullopt,                                      //
-          first, last, before, after,                             //
-          db.sessions.get<by_pk>(),                               //
+          first, last, before, after, offset,                     //
+          db->sessions.get<by_pk>(),                              //
           [](auto& obj) { return obj.by_pk(); },                  //
           [](auto& obj) { return Session{&obj}; },
           [](auto& sessions, auto key) { return sessions.lower_bound(key); },
@@ -2654,12 +4141,13 @@ struct Query
                                   std::optional<uint32_t> first,
                                   std::optional<uint32_t> last,
                                   std::optional<std::string> before,
-                                  std::optional<std::string> after) const
+                                  std::optional<std::string> after,
+                                  std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<InductionConnection, uint64_t>(
-          gt, ge, lt, le, first, last, before, after,  //
-          db.inductions.get<by_pk>(),                  //
-          [](auto& obj) { return obj.induction.id; },  //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->inductions.get<by_pk>(),                         //
+          [](auto& obj) { return obj.induction.id; },          //
           [](auto& obj) {
              return Induction{obj.induction.id, &obj.induction};
           },
@@ -2674,7 +4162,8 @@ struct Query
                                              std::optional<uint32_t> first,
                                              std::optional<uint32_t> last,
                                              std::optional<std::string> before,
-                                             std::optional<std::string> after) const
+                                             std::optional<std::string> after,
+                                             std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<InductionConnection, InductionCreatedAtKey>(
           gt ? std::optional{InductionCreatedAtKey{*gt, ~uint64_t(0)}}  //
@@ -2685,8 +4174,8 @@ struct Query
              : std::nullopt,                                            //
           le ? std::optional{InductionCreatedAtKey{*le, ~uint64_t(0)}}  //
              : std::nullopt,                                            //
-          first, last, before, after,                                   //
-          db.inductions.get<by_createdAt>(),                            //
+          first, last, before, after, offset,                           //
+          db->inductions.get<by_createdAt>(),                           //
           [](auto& obj) { return obj.by_createdAt(); },                 //
           [](auto& obj) {
              return Induction{obj.induction.id, &obj.induction};
@@ -2702,12 +4191,13 @@ struct Query
                                 std::optional<uint32_t> first,
                                 std::optional<uint32_t> last,
                                 std::optional<std::string> before,
-                                std::optional<std::string> after) const
+                                std::optional<std::string> after,
+                                std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<ElectionConnection, eosio::block_timestamp>(
-          gt, ge, lt, le, first, last, before, after,  //
-          db.elections.get<by_pk>(),                   //
-          [](auto& obj) { return obj.time; },          //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->elections.get<by_pk>(),                          //
+          [](auto& obj) { return obj.time; },                  //
           [](auto& obj) { return Election{&obj}; },
           [](auto& elections, auto key) { return elections.lower_bound(key); },
           [](auto& elections, auto key) { return elections.upper_bound(key); });
@@ -2720,12 +4210,13 @@ struct Query
                                         std::optional<uint32_t> first,
                                         std::optional<uint32_t> last,
                                         std::optional<std::string> before,
-                                        std::optional<std::string> after) const
+                                        std::optional<std::string> after,
+                                        std::optional<uint32_t> offset) const
    {
       return clchain::make_connection<DistributionConnection, eosio::block_timestamp>(
-          gt, ge, lt, le, first, last, before, after,  //
-          db.distributions.get<by_pk>(),               //
-          [](auto& obj) { return obj.time; },          //
+          gt, ge, lt, le, first, last, before, after, offset,  //
+          db->distributions.get<by_pk>(),                      //
+          [](auto& obj) { return obj.time; },                  //
           [](auto& obj) { return Distribution{&obj}; },
           [](auto& distributions, auto key) { return distributions.lower_bound(key); },
           [](auto& distributions, auto key) { return distributions.upper_bound(key); });
@@ -2737,31 +4228,99 @@ EOSIO_REFLECT2(
     status,
     masterPool,
     distributionFund,
-    method(balances, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(encryptionKeys, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(members, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(membersByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(sessions, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(inductions, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(inductionsByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(elections, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
-    method(distributions, "gt", "ge", "lt", "le", "first", "last", "before", "after"))
+    method(balances, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(encryptionKeys, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(members, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(participants, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(membersByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after",
+           "offset"),
+    method(sessions, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(inductions, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(inductionsByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after",
+           "offset"),
+    method(elections, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"),
+    method(distributions, "gt", "ge", "lt", "le", "first", "last", "before", "after", "offset"))
 
 auto schema = clchain::get_gql_schema<Query>();
-[[clang::export_name("getSchemaSize")]] uint32_t getSchemaSize()
+MICRO_CHAIN_EXPORT(getSchemaSize) uint32_t getSchemaSize()
 {
    return schema.size();
 }
-[[clang::export_name("getSchema")]] const char* getSchema()
+MICRO_CHAIN_EXPORT(getSchema) const char* getSchema()
 {
    return schema.c_str();
 }
 
-[[clang::export_name("query")]] void query(const char* query,
-                                           uint32_t size,
-                                           const char* variables,
-                                           uint32_t variables_size)
+clchain::gql_plan_cache<Query> query_plans{64};
+
+// Limits of querySnapshot, which reads them on other threads
+std::atomic<uint64_t> query_max_cost = clchain::gql_limits{}.max_cost;
+std::atomic<uint64_t> query_max_steps = clchain::gql_limits{}.max_steps;
+
+// Sets the limits of queries and subscriptions. 0 removes a limit. Subscriptions which
+// already exist keep running under the new limits.
+MICRO_CHAIN_EXPORT(setQueryLimits) void setQueryLimits(uint32_t max_cost, uint32_t max_steps)
+{
+   clchain::gql_limits limits{max_cost ? max_cost : ~uint64_t(0),
+                              max_steps ? max_steps : ~uint64_t(0)};
+   query_plans.limits = limits;
+   subscriptions.limits = limits;
+   query_max_cost = limits.max_cost;
+   query_max_steps = limits.max_steps;
+}
+
+MICRO_CHAIN_EXPORT(query) void query(const char* query,
+                                     uint32_t size,
+                                     const char* variables,
+                                     uint32_t variables_size)
 {
+   query_scope scope;
    Query root{block_log};
-   result = clchain::gql_query(root, {query, size}, {variables, variables_size});
+   result = clchain::gql_query(root, query_plans, {query, size}, {variables, variables_size});
+}
+
+#ifndef __wasm__
+MICRO_CHAIN_EXPORT(setQuerySnapshots) void setQuerySnapshots(bool enable)
+{
+   if (enable == replicas_enabled)
+      return;
+   replicas_enabled = enable;
+   if (enable)
+      return publish_replica();
+   published_replica.store(nullptr);
+   for (auto& r : replicas)
+   {
+      for (auto n = r.num_readers.load(); n; n = r.num_readers.load())
+         r.num_readers.wait(n);
+      database::for_each_table([&](auto table) { remove_all_rows(r.db.*table); });
+      r.block_log = {};
+      r.changed_ids.clear();
+      r.copy_all = true;
+   }
+}
+
+MICRO_CHAIN_EXPORT(querySnapshot) char* querySnapshot(const char* query,
+                                                     uint32_t size,
+                                                     const char* variables,
+                                                     uint32_t variables_size,
+                                                     uint32_t* result_size)
+{
+   thread_local clchain::gql_plan_cache<Query> plans{64};
+   auto* r = acquire_replica();
+   if (!r)
+      return nullptr;
+   chainbase::scope_exit release{[&] {
+      db = &live_db;
+      release_replica(r);
+   }};
+   db = &r->db;
+   query_scope scope;
+   Query root{r->block_log};
+   plans.limits = {query_max_cost.load(), query_max_steps.load()};
+   auto json = clchain::gql_query(root, plans, {query, size}, {variables, variables_size});
+   auto* data = static_cast<char*>(malloc(json.size()));
+   memcpy(data, json.data(), json.size());
+   *result_size = json.size();
+   return data;
 }
+#endif
@@ -0,0 +1,231 @@
+#include <eden-micro-chain.h>
+
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Runs every GraphQL query which the web app and eden-subchain-client ship against the native
+// micro-chain, under its default limits, and checks that none is rejected (e.g. as too
+// expensive). The queries are read out of the packages' sources: template literals whose
+// text is a selection set.
+
+int error_count;
+
+void report_error(const char* assertion, const char* file, int line)
+{
+   if (error_count <= 20)
+   {
+      std::printf("%s:%d: failed %s\n", file, line, assertion);
+   }
+   ++error_count;
+}
+
+#define CHECK(...)                                       \
+   do                                                    \
+   {                                                     \
+      if (__VA_ARGS__)                                   \
+      {                                                  \
+      }                                                  \
+      else                                               \
+      {                                                  \
+         report_error(#__VA_ARGS__, __FILE__, __LINE__); \
+      }                                                  \
+   } while (0)
+
+// A template literal: its text, split around its substitutions
+struct template_literal
+{
+   std::vector<std::string> parts;          // one more than substitutions
+   std::vector<std::string> substitutions;  // the expressions, e.g. MEMBER_DATA_FRAGMENT
+   std::string assigned_to;                 // NAME in NAME = `...`, if any
+};
+
+struct scanner
+{
+   std::string_view src;
+   size_t pos = 0;
+   std::vector<template_literal> literals;
+
+   char peek(size_t i = 0) const { return pos + i < src.size() ? src[pos + i] : 0; }
+
+   // The identifier before "= `", if the literal at pos is assigned
+   std::string assigned_name(size_t begin) const
+   {
+      auto i = begin;
+      while (i && std::isspace((unsigned char)src[i - 1]))
+         --i;
+      if (!i || src[i - 1] != '=' || (i > 1 && std::string_view{"=!<>"}.find(src[i - 2]) !=
+                                                     std::string_view::npos))
+         return {};
+      --i;
+      while (i && std::isspace((unsigned char)src[i - 1]))
+         --i;
+      auto end = i;
+      while (i && (std::isalnum((unsigned char)src[i - 1]) || src[i - 1] == '_'))
+         --i;
+      return std::string{src.substr(i, end - i)};
+   }
+
+   void skip_string(char quote)
+   {
+      ++pos;
+      while (pos < src.size() && src[pos] != quote && src[pos] != '\n')
+         pos += src[pos] == '\\' ? 2 : 1;
+      ++pos;
+   }
+
+   // Code until an unmatched close brace (which it consumes), or the end
+   void scan_code()
+   {
+      int depth = 0;
+      while (pos < src.size())
+      {
+         char c = peek();
+         if (c == '/' && peek(1) == '/')
+            while (pos < src.size() && src[pos] != '\n')
+               ++pos;
+         else if (c == '/' && peek(1) == '*')
+         {
+            auto end = src.find("*/", pos + 2);
+            pos = end == std::string_view::npos ? src.size() : end + 2;
+         }
+         else if (c == '\'' || c == '"')
+            skip_string(c);
+         else if (c == '`')
+            scan_template();
+         else if (c == '{')
+            ++depth, ++pos;
+         else if (c == '}')
+         {
+            ++pos;
+            if (!depth--)
+               return;
+         }
+         else
+            ++pos;
+      }
+   }
+
+   void scan_template()
+   {
+      template_literal lit;
+      lit.assigned_to = assigned_name(pos);
+      lit.parts.emplace_back();
+      ++pos;
+      while (pos < src.size() && src[pos] != '`')
+      {
+         if (src[pos] == '\\')
+         {
+            lit.parts.back() += src.substr(pos, 2);
+            pos += 2;
+         }
+         else if (src[pos] == '$' && peek(1) == '{')
+         {
+            pos += 2;
+            auto begin = pos;
+            scan_code();
+            lit.substitutions.emplace_back(src.substr(begin, pos - 1 - begin));
+            lit.parts.emplace_back();
+         }
+         else
+            lit.parts.back() += src[pos++];
+      }
+      ++pos;
+      literals.push_back(std::move(lit));
+   }
+};
+
+std::string read_file(const std::filesystem::path& path)
+{
+   std::ifstream f{path};
+   std::stringstream s;
+   s << f.rdbuf();
+   return s.str();
+}
+
+// Whether text, less GraphQL comments, starts with a selection set: { followed by a name
+bool is_query(const std::string& text)
+{
+   size_t i = 0;
+   while (i < text.size())
+   {
+      if (text[i] == '#')
+         i = std::min(text.find('\n', i), text.size());
+      else if (std::isspace((unsigned char)text[i]))
+         ++i;
+      else
+         break;
+   }
+   if (i >= text.size() || text[i] != '{')
+      return false;
+   while (++i < text.size() && std::isspace((unsigned char)text[i]))
+   {
+   }
+   return i < text.size() && (std::isalpha((unsigned char)text[i]) || text[i] == '_');
+}
+
+void replace_all(std::string& s, std::string_view from, std::string_view to)
+{
+   for (auto i = s.find(from); i != std::string::npos; i = s.find(from, i + to.size()))
+      s.replace(i, from.size(), to);
+}
+
+int main()
+{
+   std::vector<std::pair<std::string, template_literal>> literals;  // file, literal
+   for (auto dir : {"packages/webapp/src", "packages/eden-subchain-client/src"})
+   {
+      for (auto& entry :
+           std::filesystem::recursive_directory_iterator{std::filesystem::path{SOURCE_DIR} / dir})
+      {
+         auto ext = entry.path().extension();
+         if (ext != ".ts" && ext != ".tsx")
+            continue;
+         auto src = read_file(entry.path());
+         scanner s{src};
+         while (s.pos < src.size())
+            s.scan_code();
+         for (auto& lit : s.literals)
+            literals.emplace_back(entry.path().string(), std::move(lit));
+      }
+   }
+
+   // Fragments, e.g. MEMBER_DATA_FRAGMENT, are literals without substitutions
+   std::map<std::string, std::string> constants;
+   for (auto& [file, lit] : literals)
+      if (!lit.assigned_to.empty() && lit.substitutions.empty())
+         constants[lit.assigned_to] = lit.parts[0];
+
+   initialize(0, 0, 0, 0, 0, 0, 0, 0);
+   int num_queries = 0;
+   for (auto& [file, lit] : literals)
+   {
+      std::string text = lit.parts[0];
+      for (size_t i = 0; i < lit.substitutions.size(); ++i)
+      {
+         auto it = constants.find(lit.substitutions[i]);
+         // Other substitutions are values, such as account names and block numbers
+         text += it != constants.end() ? it->second : "1";
+         text += lit.parts[i + 1];
+      }
+      if (!is_query(text))
+         continue;
+      replace_all(text, "@page@", "first:20");  // see usePagedQuery
+      ++num_queries;
+      query(text.data(), text.size(), nullptr, 0);
+      std::string result{getResult(), getResultSize()};
+      CHECK(result.find("\"errors\"") == std::string::npos);
+      if (result.find("\"errors\"") != std::string::npos)
+         std::printf("%s:\n%s\n%s\n", file.c_str(), text.c_str(), result.c_str());
+   }
+   CHECK(num_queries >= 10);
+   std::printf("%d queries\n", num_queries);
+   if (error_count)
+      return 1;
+}
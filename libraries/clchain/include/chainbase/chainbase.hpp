@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chainbase/pool_allocator.hpp>
 #include <chainbase/undo_index.hpp>
 
 #include <boost/core/demangle.hpp>
@@ -18,10 +19,10 @@ namespace chainbase
    using std::vector;
 
    template <typename T>
-   using allocator = std::allocator<T>;
+   using allocator = pool_allocator<T>;
 
    template <typename T>
-   using node_allocator = std::allocator<T>;
+   using node_allocator = pool_allocator<T>;
 
    /**
     *  Object ID type that includes the type of the object it references
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace chainbase
+{
+   // Hands out fixed-size blocks from free lists, one list per size class. Blocks are
+   // carved from large chunks, so creating a node or backing one up for undo doesn't need
+   // a malloc, and nodes of similar sizes pack together instead of scattering over the
+   // heap. Freed blocks go back on their list for the next node of that size class; the
+   // chunks themselves are kept for the life of the process. (wasm memory never shrinks,
+   // so returning them to malloc wouldn't make the heap smaller.)
+   //
+   // Not thread safe.
+   class node_pool
+   {
+     public:
+      static constexpr std::size_t granularity = 16;
+      static constexpr std::size_t max_size = 1024;
+      static constexpr std::size_t chunk_size = 64 * 1024;
+
+      static constexpr bool is_pooled(std::size_t size, std::size_t align)
+      {
+         return size <= max_size && align <= granularity;
+      }
+
+      void* allocate(std::size_t size)
+      {
+         auto& head = free_lists[size_class(size)];
+         if (head)
+         {
+            auto result = head;
+            head = head->next;
+            return result;
+         }
+         auto block_size = (size_class(size) + 1) * granularity;
+         if (remaining() < block_size)
+         {
+            // The tail of the old chunk is too small for this class; hand it to the
+            // classes that fit instead of wasting it.
+            while (remaining() >= granularity)
+            {
+               auto tail_class = remaining() / granularity - 1;
+               if (tail_class >= num_classes)
+                  tail_class = num_classes - 1;
+               push(tail_class, chunk_pos);
+               chunk_pos += (tail_class + 1) * granularity;
+            }
+            chunk_pos = static_cast<char*>(::operator new(chunk_size));
+            chunk_end = chunk_pos + chunk_size;
+         }
+         auto result = chunk_pos;
+         chunk_pos += block_size;
+         return result;
+      }
+
+      void deallocate(void* p, std::size_t size) noexcept { push(size_class(size), p); }
+
+     private:
+      struct free_block
+      {
+         free_block* next;
+      };
+
+      static constexpr std::size_t num_classes = max_size / granularity;
+
+      static constexpr std::size_t size_class(std::size_t size)
+      {
+         return size ? (size - 1) / granularity : 0;
+      }
+
+      std::size_t remaining() const { return chunk_end - chunk_pos; }
+
+      void push(std::size_t cls, void* p) noexcept
+      {
+         auto block = static_cast<free_block*>(p);
+         block->next = free_lists[cls];
+         free_lists[cls] = block;
+      }
+
+      free_block* free_lists[num_classes] = {};
+      char* chunk_pos = nullptr;
+      char* chunk_end = nullptr;
+   };
+
+   // Shared by every pool_allocator. Constant-initialized and trivially destructible, so
+   // containers with static storage duration may use it during their own destruction.
+   inline node_pool global_node_pool;
+
+   // Allocates single objects from global_node_pool; arrays and large or over-aligned
+   // objects fall back to std::allocator.
+   template <typename T>
+   class pool_allocator
+   {
+     public:
+      using value_type = T;
+
+      pool_allocator() = default;
+      template <typename U>
+      pool_allocator(const pool_allocator<U>&) noexcept
+      {
+      }
+
+      T* allocate(std::size_t n)
+      {
+         if (n == 1 && node_pool::is_pooled(sizeof(T), alignof(T)))
+            return static_cast<T*>(global_node_pool.allocate(sizeof(T)));
+         return std::allocator<T>{}.allocate(n);
+      }
+
+      void deallocate(T* p, std::size_t n) noexcept
+      {
+         if (n == 1 && node_pool::is_pooled(sizeof(T), alignof(T)))
+            global_node_pool.deallocate(p, sizeof(T));
+         else
+            std::allocator<T>{}.deallocate(p, n);
+      }
+
+      template <typename U>
+      friend bool operator==(const pool_allocator&, const pool_allocator<U>&)
+      {
+         return true;
+      }
+      template <typename U>
+      friend bool operator!=(const pool_allocator&, const pool_allocator<U>&)
+      {
+         return false;
+      }
+   };
+}  // namespace chainbase
@@ -8,13 +8,21 @@
 #include <boost/intrusive/slist.hpp>
 #include <boost/mp11/algorithm.hpp>
 #include <boost/mp11/list.hpp>
+#include <boost/multi_index/hashed_index_fwd.hpp>
+#include <boost/multi_index/ranked_index_fwd.hpp>
 #include <boost/multi_index_container_fwd.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <eosio/check.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <map>
 #include <memory>
 #include <sstream>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace chainbase
 {
@@ -67,6 +75,38 @@ namespace chainbase
       int _color;
    };
 
+   template <typename OrderedIndex>
+   constexpr bool is_ranked_index = false;
+   template <typename... T>
+   constexpr bool is_ranked_index<boost::multi_index::ranked_unique<T...>> = true;
+
+   // Nodes of ranked indices also hold the number of nodes in their subtree
+   template <typename... T>
+   struct offset_node_base<boost::multi_index::ranked_unique<T...>> : offset_node_base<void>
+   {
+      offset_node_base() = default;
+      offset_node_base(const offset_node_base&) {}
+      constexpr offset_node_base& operator=(const offset_node_base&) { return *this; }
+      std::size_t _size;
+   };
+
+   template <typename Index>
+   constexpr bool is_hashed_index = false;
+   template <typename... T>
+   constexpr bool is_hashed_index<boost::multi_index::hashed_unique<T...>> = true;
+
+   // Nodes of hashed indices are chained within their bucket, and remember their hash so
+   // the table can grow without rehashing keys
+   template <typename... T>
+   struct offset_node_base<boost::multi_index::hashed_unique<T...>>
+   {
+      offset_node_base() = default;
+      offset_node_base(const offset_node_base&) {}
+      constexpr offset_node_base& operator=(const offset_node_base&) { return *this; }
+      std::ptrdiff_t _next;
+      std::size_t _hash;
+   };
+
    template <class Tag>
    struct offset_node_traits
    {
@@ -95,10 +135,9 @@ namespace chainbase
       }
       static void set_left(node_ptr n, node_ptr left)
       {
-         if (left == nullptr)
-            n->_left = 1;
-         else
-            n->_left = (char*)left - (char*)n;
+         set_link(n, n->_left, left);
+         if constexpr (is_ranked_index<Tag>)
+            changed_nodes().add(n);
       }
       static node_ptr get_right(const_node_ptr n)
       {
@@ -108,10 +147,49 @@ namespace chainbase
       }
       static void set_right(node_ptr n, node_ptr right)
       {
-         if (right == nullptr)
-            n->_right = 1;
+         set_link(n, n->_right, right);
+         if constexpr (is_ranked_index<Tag>)
+            changed_nodes().add(n);
+      }
+      static void set_link(node_ptr n, std::ptrdiff_t& link, node_ptr target)
+      {
+         if (target == nullptr)
+            link = 1;
          else
-            n->_right = (char*)right - (char*)n;
+            link = (char*)target - (char*)n;
+      }
+      // Nodes whose children changed since the subtree sizes were last updated.
+      //
+      // Links also change inside noexcept operations (remove, undo), so the list never
+      // allocates after it's created; its capacity is reserved when the first tree is
+      // constructed. Rebalancing after one insert or erase relinks O(log n) nodes, far fewer
+      // than that. If it's ever exceeded, the list overflows instead, and the next update
+      // recomputes every size in the tree.
+      struct changed_node_list
+      {
+         static constexpr std::size_t reserved = 4096;
+
+         changed_node_list() { nodes.reserve(reserved); }
+         void add(node_ptr n) noexcept
+         {
+            if (nodes.size() < nodes.capacity())
+               nodes.push_back(n);
+            else
+               overflowed = true;
+         }
+         void clear() noexcept
+         {
+            nodes.clear();
+            overflowed = false;
+         }
+
+         std::vector<node_ptr> nodes;
+         bool overflowed = false;
+      };
+      static changed_node_list& changed_nodes()
+      {
+         static changed_node_list list;
+         return list;
       }
       // red-black tree
       static color get_color(node_ptr n) { return n->_color; }
@@ -128,9 +206,12 @@ namespace chainbase
 
       // list
       static node_ptr get_next(const_node_ptr n) { return get_right(n); }
-      static void set_next(node_ptr n, node_ptr next) { set_right(n, next); }
+      static void set_next(node_ptr n, node_ptr next) { set_link(n, n->_right, next); }
       static node_ptr get_previous(const_node_ptr n) { return get_left(n); }
-      static void set_previous(node_ptr n, node_ptr previous) { set_left(n, previous); }
+      static void set_previous(node_ptr n, node_ptr previous)
+      {
+         set_link(n, n->_left, previous);
+      }
    };
 
    template <typename Node, typename Tag>
@@ -195,12 +276,47 @@ namespace chainbase
    constexpr bool is_valid_index = false;
    template <typename... T>
    constexpr bool is_valid_index<boost::multi_index::ordered_unique<T...>> = true;
+   template <typename... T>
+   constexpr bool is_valid_index<boost::multi_index::ranked_unique<T...>> = true;
+   template <typename... T>
+   constexpr bool is_valid_index<boost::multi_index::hashed_unique<T...>> = true;
 
    template <typename Node, typename Tag>
    using list_base =
        boost::intrusive::slist<typename Node::value_type,
                                boost::intrusive::value_traits<offset_node_value_traits<Node, Tag>>>;
 
+   // Objects may name cheap fields, e.g. a flag or a counter, by returning references to
+   // them from undo_fields() (usually through std::tie). undo_index::modify_fields then
+   // backs up only those fields instead of copying the whole object.
+   template <typename T>
+   concept has_undo_fields = requires(T& t) { t.undo_fields(); };
+
+   template <typename T>
+   struct undo_fields_of
+   {
+      using type = std::tuple<>;
+   };
+   template <has_undo_fields T>
+   struct undo_fields_of<T>
+   {
+      using type = boost::mp11::mp_transform<std::remove_reference_t,
+                                             decltype(std::declval<T&>().undo_fields())>;
+   };
+   template <typename T>
+   using undo_fields_t = typename undo_fields_of<T>::type;
+
+   // Nodes of objects with undo_fields also remember when those fields were last backed up
+   template <bool HasUndoFields>
+   struct fields_mtime_holder
+   {
+   };
+   template <>
+   struct fields_mtime_holder<true>
+   {
+      uint64_t _fields_mtime = 0;
+   };
+
    template <typename L, typename It, typename Pred, typename Disposer>
    void remove_if_after_and_dispose(L& l, It it, It end, Pred&& p, Disposer&& d)
    {
@@ -228,6 +344,17 @@ namespace chainbase
    struct set_impl : private set_base<Node, OrderedIndex>
    {
       using base_type = set_base<Node, OrderedIndex>;
+
+      // Constructing the tree links its header to itself, which ranked indices record as a
+      // change. Another tree of the same type would then walk up from this header when it
+      // updates its sizes.
+      set_impl() { discard_changes(); }
+      template <typename Allocator>
+      explicit set_impl(const Allocator&)
+      {
+         discard_changes();
+      }
+
       // Allow compatible keys to match multi_index
       template <typename K>
       auto find(K&& k) const
@@ -256,10 +383,435 @@ namespace chainbase
       using base_type::rbegin;
       using base_type::rend;
       using base_type::size;
+
+      // Ranked indices find the position of an element, or the element at a position, in
+      // O(log n). These match ranked indices in boost::multi_index.
+      std::size_t rank(typename base_type::const_iterator it) const
+         requires is_ranked_index<OrderedIndex>
+      {
+         auto n = it.pointed_node();
+         auto header = header_node();
+         if (n == header)
+            return size();
+         std::size_t result = subtree_size(node_traits::get_left(n));
+         for (auto p = node_traits::get_parent(n); p != header; p = node_traits::get_parent(n))
+         {
+            if (node_traits::get_right(p) == n)
+               result += subtree_size(node_traits::get_left(p)) + 1;
+            n = p;
+         }
+         return result;
+      }
+      auto nth(std::size_t n) const requires is_ranked_index<OrderedIndex>
+      {
+         if (n >= size())
+            return end();
+         auto node = node_traits::get_parent(header_node());
+         for (;;)
+         {
+            auto left_size = subtree_size(node_traits::get_left(node));
+            if (n < left_size)
+               node = node_traits::get_left(node);
+            else if (n == left_size)
+               return iterator_to(*value_traits::to_value_ptr(node));
+            else
+            {
+               n -= left_size + 1;
+               node = node_traits::get_right(node);
+            }
+         }
+      }
+      template <typename K>
+      std::size_t lower_bound_rank(K&& k) const requires is_ranked_index<OrderedIndex>
+      {
+         return rank(lower_bound(static_cast<K&&>(k)));
+      }
+      template <typename K>
+      std::size_t upper_bound_rank(K&& k) const requires is_ranked_index<OrderedIndex>
+      {
+         return rank(upper_bound(static_cast<K&&>(k)));
+      }
+
       template <typename T, typename Allocator, typename... Indices>
       friend class undo_index;
+
+     private:
+      using value_traits = offset_node_value_traits<Node, OrderedIndex>;
+      using node_traits = typename value_traits::node_traits;
+      using node_ptr = typename node_traits::node_ptr;
+      using typename base_type::const_iterator;
+      using typename base_type::iterator;
+      using typename base_type::reference;
+
+      node_ptr header_node() const { return end().pointed_node(); }
+      static std::size_t subtree_size(node_ptr n) { return n ? n->_size : 0; }
+
+      // Recomputes the subtree sizes which were invalidated by relinking nodes. A node's
+      // subtree only changes if it, or one of its descendants, got new children.
+      void update_sizes(node_ptr removed = nullptr)
+      {
+         if constexpr (is_ranked_index<OrderedIndex>)
+         {
+            auto& changed = node_traits::changed_nodes();
+            auto header = header_node();
+            if (changed.overflowed)
+               recompute_size(node_traits::get_parent(header));
+            else
+            {
+               for (auto n : changed.nodes)
+               {
+                  if (n == removed)
+                     continue;
+                  for (; n != header; n = node_traits::get_parent(n))
+                     n->_size = subtree_size(node_traits::get_left(n)) +
+                                subtree_size(node_traits::get_right(n)) + 1;
+               }
+            }
+            changed.clear();
+         }
+      }
+      static std::size_t recompute_size(node_ptr n) noexcept
+      {
+         if (!n)
+            return 0;
+         n->_size = recompute_size(node_traits::get_left(n)) +
+                    recompute_size(node_traits::get_right(n)) + 1;
+         return n->_size;
+      }
+      void discard_changes()
+      {
+         if constexpr (is_ranked_index<OrderedIndex>)
+            node_traits::changed_nodes().clear();
+      }
+
+      // Every operation which relinks nodes goes through these, so that ranked indices can
+      // keep their subtree sizes up to date
+      std::pair<iterator, bool> insert_unique(reference value)
+      {
+         auto result = base_type::insert_unique(value);
+         update_sizes();
+         return result;
+      }
+      iterator insert_equal(reference value)
+      {
+         auto result = base_type::insert_equal(value);
+         update_sizes();
+         return result;
+      }
+      iterator insert_before(const_iterator pos, reference value)
+      {
+         auto result = base_type::insert_before(pos, value);
+         update_sizes();
+         return result;
+      }
+      void push_back(reference value)
+      {
+         base_type::push_back(value);
+         update_sizes();
+      }
+      iterator erase(const_iterator pos)
+      {
+         auto n = pos.pointed_node();
+         auto result = base_type::erase(pos);
+         update_sizes(n);
+         return result;
+      }
+      template <typename Disposer>
+      iterator erase_and_dispose(const_iterator b, const_iterator e, Disposer&& disposer)
+      {
+         if constexpr (is_ranked_index<OrderedIndex>)
+         {
+            while (b != e)
+            {
+               auto& value = const_cast<reference>(*b);
+               b = erase(b);
+               disposer(&value);
+            }
+            return b.unconst();
+         }
+         else
+         {
+            return base_type::erase_and_dispose(b, e, static_cast<Disposer&&>(disposer));
+         }
+      }
+      void clear()
+      {
+         base_type::clear();
+         discard_changes();
+      }
+      template <typename Disposer>
+      void clear_and_dispose(Disposer&& disposer)
+      {
+         base_type::clear_and_dispose(static_cast<Disposer&&>(disposer));
+         discard_changes();
+      }
    };
 
+   // A chained hash table for indices which only need point lookups. find is O(1) instead
+   // of a walk down a tree, but there's no order, so no lower_bound or ranges.
+   //
+   // Like the trees, links are offsets, and the bucket array comes from the undo_index's
+   // allocator. The array only grows: undo reinserts removed nodes without allocating,
+   // which works because the table once held all of them.
+   template <typename Node, typename HashedIndex, typename Allocator>
+   struct hash_impl
+   {
+      using value_type = typename Node::value_type;
+      using reference = value_type&;
+      using key_of_value = get_key<typename HashedIndex::key_from_value_type, value_type>;
+      using key_type = typename key_of_value::type;
+      using hasher = typename HashedIndex::hash_type;
+      using key_equal = typename HashedIndex::pred_type;
+
+     private:
+      using value_traits = offset_node_value_traits<Node, HashedIndex>;
+      using node_ptr = offset_node_base<HashedIndex>*;
+      using bucket_allocator = rebind_alloc_t<Allocator, std::ptrdiff_t>;
+      using bucket_traits = std::allocator_traits<bucket_allocator>;
+
+     public:
+      class const_iterator
+      {
+        public:
+         using iterator_category = std::forward_iterator_tag;
+         using value_type = typename Node::value_type;
+         using difference_type = std::ptrdiff_t;
+         using pointer = const value_type*;
+         using reference = const value_type&;
+
+         const_iterator() = default;
+         reference operator*() const { return *value_traits::to_value_ptr(_node); }
+         pointer operator->() const { return value_traits::to_value_ptr(_node); }
+         const_iterator& operator++()
+         {
+            _node = _table->next_node(_node);
+            return *this;
+         }
+         const_iterator operator++(int)
+         {
+            auto result = *this;
+            ++*this;
+            return result;
+         }
+         friend bool operator==(const const_iterator& a, const const_iterator& b)
+         {
+            return a._node == b._node;
+         }
+         friend bool operator!=(const const_iterator& a, const const_iterator& b)
+         {
+            return a._node != b._node;
+         }
+
+        private:
+         friend struct hash_impl;
+         const_iterator(const hash_impl* table, node_ptr node) : _table(table), _node(node) {}
+         const hash_impl* _table = nullptr;
+         node_ptr _node = nullptr;
+      };
+      using iterator = const_iterator;
+
+      hash_impl() = default;
+      explicit hash_impl(const Allocator& a) : _bucket_allocator{a} {}
+      hash_impl(const hash_impl&) = delete;
+      hash_impl& operator=(const hash_impl&) = delete;
+      ~hash_impl()
+      {
+         if (_buckets)
+            bucket_traits::deallocate(_bucket_allocator, _buckets, bucket_count());
+      }
+
+      template <typename K>
+      const_iterator find(const K& k) const
+      {
+         if (!_buckets)
+            return end();
+         auto h = hash_of(k);
+         for (auto n = get_bucket(bucket_of(h)); n; n = get_next(n))
+            if (n->_hash == h && key_equal{}(key_of_value{}(*value_traits::to_value_ptr(n)), k))
+               return {this, n};
+         return end();
+      }
+      template <typename K>
+      std::size_t count(const K& k) const
+      {
+         return find(k) != end();
+      }
+      const_iterator begin() const
+      {
+         for (std::size_t b = 0; b < bucket_count(); ++b)
+            if (auto n = get_bucket(b))
+               return {this, n};
+         return end();
+      }
+      const_iterator end() const { return {this, nullptr}; }
+      const_iterator iterator_to(const value_type& value) const
+      {
+         return {this, node_ptr(value_traits::to_node_ptr(value))};
+      }
+      std::size_t size() const { return _size; }
+      bool empty() const { return _size == 0; }
+
+      template <typename T, typename A, typename... Indices>
+      friend class undo_index;
+
+     private:
+      std::pair<iterator, bool> insert_unique(reference value)
+      {
+         auto n = node_ptr(value_traits::to_node_ptr(value));
+         n->_hash = hash_of(key_of_value{}(value));
+         if (auto existing = find_other(n); existing != end())
+            return {existing, false};
+         if (_size >= bucket_count())
+            grow();
+         link(n);
+         ++_size;
+         return {{this, n}, true};
+      }
+      iterator erase(const_iterator pos)
+      {
+         auto next = pos;
+         ++next;
+         unlink(pos._node);
+         --_size;
+         return next;
+      }
+      void clear()
+      {
+         for (std::size_t b = 0; b < bucket_count(); ++b)
+            set_bucket(b, nullptr);
+         _size = 0;
+      }
+
+      // Moves a modified value to the bucket for its new key. Returns false if check_unique
+      // and another value has the same key; value stays linked, so that the caller can put
+      // back the old key or erase it.
+      bool post_modify(reference value, bool check_unique)
+      {
+         auto n = node_ptr(value_traits::to_node_ptr(value));
+         auto h = hash_of(key_of_value{}(value));
+         if (h != n->_hash)
+         {
+            unlink(n);
+            n->_hash = h;
+            link(n);
+         }
+         return !check_unique || find_other(n) == end();
+      }
+
+      const_iterator find_other(node_ptr n) const
+      {
+         if (!_buckets)
+            return end();
+         const auto& k = key_of_value{}(*value_traits::to_value_ptr(n));
+         for (auto p = get_bucket(bucket_of(n->_hash)); p; p = get_next(p))
+            if (p != n && p->_hash == n->_hash &&
+                key_equal{}(key_of_value{}(*value_traits::to_value_ptr(p)), k))
+               return {this, p};
+         return end();
+      }
+
+      template <typename K>
+      static std::size_t hash_of(const K& k)
+      {
+         return hasher{}(k);
+      }
+      // Fibonacci hashing spreads keys whose hashes differ only in their high bits (e.g.
+      // eosio::name) over the buckets
+      std::size_t bucket_of(std::size_t h) const
+      {
+         return (uint64_t(h) * 0x9e37'79b9'7f4a'7c15) >> (64 - _bucket_bits);
+      }
+      std::size_t bucket_count() const { return _buckets ? std::size_t(1) << _bucket_bits : 0; }
+
+      node_ptr get_bucket(std::size_t b) const
+      {
+         auto& slot = _buckets[b];
+         if (slot == 1)
+            return nullptr;
+         return (node_ptr)((char*)&slot + slot);
+      }
+      void set_bucket(std::size_t b, node_ptr n)
+      {
+         auto& slot = _buckets[b];
+         slot = n ? (char*)n - (char*)&slot : 1;
+      }
+      static node_ptr get_next(node_ptr n)
+      {
+         if (n->_next == 1)
+            return nullptr;
+         return (node_ptr)((char*)n + n->_next);
+      }
+      static void set_next(node_ptr n, node_ptr next)
+      {
+         n->_next = next ? (char*)next - (char*)n : 1;
+      }
+      node_ptr next_node(node_ptr n) const
+      {
+         if (auto next = get_next(n))
+            return next;
+         for (auto b = bucket_of(n->_hash) + 1; b < bucket_count(); ++b)
+            if (auto next = get_bucket(b))
+               return next;
+         return nullptr;
+      }
+
+      void link(node_ptr n)
+      {
+         auto b = bucket_of(n->_hash);
+         set_next(n, get_bucket(b));
+         set_bucket(b, n);
+      }
+      void unlink(node_ptr n)
+      {
+         auto b = bucket_of(n->_hash);
+         auto p = get_bucket(b);
+         if (p == n)
+         {
+            set_bucket(b, get_next(n));
+            return;
+         }
+         while (get_next(p) != n)
+            p = get_next(p);
+         set_next(p, get_next(n));
+      }
+
+      void grow()
+      {
+         auto old_buckets = _buckets;
+         auto old_count = bucket_count();
+         auto new_bits = old_buckets ? _bucket_bits + 1 : min_bucket_bits;
+         auto new_count = std::size_t(1) << new_bits;
+         _buckets = bucket_traits::allocate(_bucket_allocator, new_count);
+         _bucket_bits = new_bits;
+         for (std::size_t b = 0; b < new_count; ++b)
+            set_bucket(b, nullptr);
+         for (std::size_t b = 0; b < old_count; ++b)
+         {
+            auto& slot = old_buckets[b];
+            for (auto n = slot == 1 ? nullptr : (node_ptr)((char*)&slot + slot); n;)
+            {
+               auto next = get_next(n);
+               link(n);
+               n = next;
+            }
+         }
+         if (old_buckets)
+            bucket_traits::deallocate(_bucket_allocator, old_buckets, old_count);
+      }
+
+      static constexpr uint8_t min_bucket_bits = 4;
+
+      typename bucket_traits::pointer _buckets = nullptr;
+      std::size_t _size = 0;
+      uint8_t _bucket_bits = 0;
+      bucket_allocator _bucket_allocator;
+   };
+
+   template <typename Node, typename Index, typename Allocator>
+   using index_container = std::conditional_t<is_hashed_index<Index>,
+                                              hash_impl<Node, Index, Allocator>,
+                                              set_impl<Node, Index>>;
+
    template <typename T, typename S>
    class chainbase_node_allocator;
 
@@ -291,7 +843,7 @@ namespace chainbase
    }
 
    // Similar to boost::multi_index_container with an undo stack.
-   // Indices should be instances of ordered_unique.
+   // Indices should be instances of ordered_unique, ranked_unique, or hashed_unique.
    template <typename T, typename Allocator, typename... Indices>
    class undo_index
    {
@@ -300,11 +852,16 @@ namespace chainbase
       using value_type = T;
       using allocator_type = Allocator;
 
-      static_assert((... && is_valid_index<Indices>), "Only ordered_unique indices are supported");
+      static_assert((... && is_valid_index<Indices>),
+                    "Only ordered_unique, ranked_unique, and hashed_unique indices are supported");
 
       undo_index() = default;
       explicit undo_index(const Allocator& a)
-          : _undo_stack{a}, _allocator{a}, _old_values_allocator{a}
+          : _indices{index_allocator<Indices>(a)...},
+            _undo_stack{a},
+            _allocator{a},
+            _old_values_allocator{a},
+            _old_fields_allocator{a}
       {
       }
       ~undo_index()
@@ -320,7 +877,9 @@ namespace chainbase
             eosio::check(false, "content of memory does not match data expected by executable");
       }
 
-      struct node : hook<Indices, Allocator>..., value_holder<T>
+      struct node : hook<Indices, Allocator>...,
+                    value_holder<T>,
+                    fields_mtime_holder<has_undo_fields<T>>
       {
          using value_type = T;
          using allocator_type = Allocator;
@@ -333,7 +892,7 @@ namespace chainbase
       };
       static constexpr int erased_flag = 2;  // 0,1,and -1 are used by the tree
 
-      using indices_type = std::tuple<set_impl<node, Indices>...>;
+      using indices_type = std::tuple<index_container<node, Indices, Allocator>...>;
 
       using index0_set_type = std::tuple_element_t<0, indices_type>;
       using alloc_traits = typename std::allocator_traits<Allocator>::template rebind_traits<node>;
@@ -342,6 +901,7 @@ namespace chainbase
                     "first index must be id");
 
       using index0_type = boost::mp11::mp_first<boost::mp11::mp_list<Indices...>>;
+      static_assert(!is_hashed_index<index0_type>, "first index must be ordered");
       struct old_node : hook<index0_type, Allocator>, value_holder<T>
       {
          using value_type = T;
@@ -354,6 +914,21 @@ namespace chainbase
          typename alloc_traits::pointer _current;  // pointer to the actual node
       };
 
+      struct fields_backup
+      {
+         id_type id;
+         undo_fields_t<T> fields;
+      };
+      struct fields_node : hook<index0_type, Allocator>, value_holder<fields_backup>
+      {
+         using value_type = fields_backup;
+         using allocator_type = Allocator;
+         explicit fields_node(const fields_backup& b) : value_holder<fields_backup>{b} {}
+         // The later of the node's _mtime and _fields_mtime. Restored to _fields_mtime on undo.
+         uint64_t _mtime = 0;
+         typename alloc_traits::pointer _current;  // pointer to the actual node
+      };
+
       using id_pointer = id_type*;
       using pointer = value_type*;
       using const_iterator = typename index0_set_type::const_iterator;
@@ -386,6 +961,7 @@ namespace chainbase
       // squash: drop the last undo state
       // create: nop
       // modify: push a copy of the object onto old_values
+      // modify_fields: push a copy of the object's undo_fields onto old_fields
       // remove: move node to removed index and set removed flag
       //
       // Operations on a given key MUST always follow the sequence: CREATE MODIFY* REMOVE?
@@ -398,6 +974,14 @@ namespace chainbase
       // These optimizations may be applied at any time, but are not required by the class
       // invariants.
       //
+      // old_fields works like old_values, but only holds the fields named by undo_fields().
+      // A node's _fields_mtime records when they were last backed up. Undo restores
+      // old_values before old_fields: if modify follows modify_fields, the copy in old_values
+      // already has the new fields, and old_fields puts back the original ones. A fields
+      // backup is redundant if the node's _mtime or _fields_mtime shows that the whole object
+      // or its fields were already backed up in the session, so its _mtime holds the later
+      // of the two.
+      //
       // Notes regarding memory:
       // Nodes in the main table share the same layout as nodes in removed_values and may
       // be freely moved between the two.  This permits undo to restore removed nodes
@@ -407,6 +991,8 @@ namespace chainbase
       {
          typename std::allocator_traits<Allocator>::pointer old_values_end;
          typename std::allocator_traits<Allocator>::pointer removed_values_end;
+         typename std::allocator_traits<rebind_alloc_t<Allocator, fields_backup>>::pointer
+             old_fields_end;
          id_type old_next_id = 0;
          uint64_t ctime = 0;  // _monotonic_revision at the point the undo_state was created
       };
@@ -436,6 +1022,31 @@ namespace chainbase
          return p->_item;
       }
 
+      // Inserts a copy of obj, keeping its id, e.g. to keep a replica of another index up to
+      // date. Copies aren't recorded for undo, so this requires an empty undo stack.
+      // Exception safety: strong
+      const value_type& insert_copy(const value_type& obj)
+      {
+         if (_undo_stack.size() != 0)
+            eosio::check(false, "cannot insert a copy while there is an existing undo stack");
+         auto p = alloc_traits::allocate(_allocator, 1);
+         auto guard0 = scope_exit{[&] { alloc_traits::deallocate(_allocator, p, 1); }};
+         auto constructor = [&](value_type& v) { v = obj; };
+         alloc_traits::construct(_allocator, &*p, constructor, propagate_allocator(_allocator));
+         auto guard1 = scope_exit{[&] { alloc_traits::destroy(_allocator, &*p); }};
+         if (!insert_impl(p->_item))
+            eosio::check(
+                false, "could not insert object, most likely a uniqueness constraint was violated");
+         if (_next_id <= obj.id)
+         {
+            _next_id = obj.id;
+            ++_next_id;
+         }
+         guard1.cancel();
+         guard0.cancel();
+         return p->_item;
+      }
+
       // Exception safety: basic.
       // If the modifier leaves the object in a state that conflicts
       // with another object, it will either be reverted or erased.
@@ -452,6 +1063,7 @@ namespace chainbase
                   if (backup)
                   {
                      node_ref = std::move(*backup);
+                     to_node(node_ref)._mtime = to_old_node(*backup)._mtime;
                      bool success = post_modify<true, 1>(node_ref);
                      (void)success;
                      assert(success);
@@ -478,6 +1090,51 @@ namespace chainbase
                 false, "could not modify object, most likely a uniqueness constraint was violated");
       }
 
+      // Like modify, but m may only change the fields returned by obj.undo_fields(). Only
+      // those fields are backed up for undo.
+      //
+      // Exception safety: basic.
+      template <typename Modifier>
+      void modify_fields(const value_type& obj, Modifier&& m) requires has_undo_fields<T>
+      {
+         fields_backup* backup = on_modify_fields(obj);
+         value_type& node_ref = const_cast<value_type&>(obj);
+         bool success = false;
+         {
+            auto guard0 = scope_exit{[&] {
+               if (!post_modify<true, 1>(node_ref))
+               {  // The object id cannot be modified
+                  if (backup)
+                  {
+                     node_ref.undo_fields() = std::move(backup->fields);
+                     to_node(node_ref)._fields_mtime = to_fields_node(*backup)._mtime;
+                     bool success = post_modify<true, 1>(node_ref);
+                     (void)success;
+                     assert(success);
+                     assert(backup == &_old_fields.front());
+                     _old_fields.pop_front_and_dispose(
+                         [this](fields_backup* p) { dispose_fields(*p); });
+                  }
+                  else
+                  {
+                     remove(obj);
+                  }
+               }
+               else
+               {
+                  success = true;
+               }
+            }};
+            auto old_id = obj.id;
+            m(node_ref);
+            (void)old_id;
+            assert(obj.id == old_id);
+         }
+         if (!success)
+            eosio::check(
+                false, "could not modify object, most likely a uniqueness constraint was violated");
+      }
+
       // Allows testing whether a value has been removed from the undo_index.
       //
       // The lifetime of an object removed through a removed_nodes_tracker
@@ -642,6 +1299,21 @@ namespace chainbase
          return {_revision - _undo_stack.size(), _revision};
       }
 
+      id_type next_id() const { return _next_id; }
+
+      // Allows objects to be recreated with their original ids, e.g. when loading a snapshot.
+      // Ids are assigned by emplace; this only skips over unused ones.
+      void set_next_id(id_type id)
+      {
+         if (_undo_stack.size() != 0)
+            eosio::check(false, "cannot set next id while there is an existing undo stack");
+
+         if (id < _next_id)
+            eosio::check(false, "next id cannot decrease");
+
+         _next_id = id;
+      }
+
       /**
        * Discards all undo history prior to revision
        */
@@ -656,7 +1328,8 @@ namespace chainbase
          else if (static_cast<uint64_t>(_revision - revision) < _undo_stack.size())
          {
             auto iter = _undo_stack.begin() + (_undo_stack.size() - (_revision - revision));
-            dispose(get_old_values_end(*iter), get_removed_values_end(*iter));
+            dispose(get_old_values_end(*iter), get_removed_values_end(*iter),
+                    get_old_fields_end(*iter));
             _undo_stack.erase(_undo_stack.begin(), iter);
          }
       }
@@ -687,10 +1360,9 @@ namespace chainbase
       template <int N, typename Iter>
       auto project(Iter iter) const
       {
-         if (iter == get<boost::mp11::mp_find<
-                         boost::mp11::mp_list<typename set_impl<node, Indices>::const_iterator...>,
-                         Iter>::value>()
-                         .end())
+         using iterators = boost::mp11::mp_list<
+             typename index_container<node, Indices, Allocator>::const_iterator...>;
+         if (iter == get<boost::mp11::mp_find<iterators, Iter>::value>().end())
             return get<N>().end();
          return get<N>().iterator_to(*iter);
       }
@@ -699,11 +1371,13 @@ namespace chainbase
 
       struct delta
       {
-         boost::mpl::iterator_range<typename index0_set_type::const_iterator> new_values;
-         boost::mpl::iterator_range<typename list_base<old_node, index0_type>::const_iterator>
+         boost::iterator_range<typename index0_set_type::const_iterator> new_values;
+         boost::iterator_range<typename list_base<old_node, index0_type>::const_iterator>
              old_values;
-         boost::mpl::iterator_range<typename list_base<node, index0_type>::const_iterator>
+         boost::iterator_range<typename list_base<node, index0_type>::const_iterator>
              removed_values;
+         boost::iterator_range<typename list_base<fields_node, index0_type>::const_iterator>
+             old_fields;
       };
 
       delta last_undo_session() const
@@ -711,18 +1385,91 @@ namespace chainbase
          if (_undo_stack.empty())
             return {{get<0>().end(), get<0>().end()},
                     {_old_values.end(), _old_values.end()},
-                    {_removed_values.end(), _removed_values.end()}};
+                    {_removed_values.end(), _removed_values.end()},
+                    {_old_fields.end(), _old_fields.end()}};
          // Warning: This is safe ONLY as long as nothing exposes the undo stack to client code.
          // Compressing the undo stack does not change the logical state of the undo_index.
          const_cast<undo_index*>(this)->compress_last_undo_session();
          return {{get<0>().lower_bound(_undo_stack.back().old_next_id), get<0>().end()},
                  {_old_values.begin(), get_old_values_end(_undo_stack.back())},
-                 {_removed_values.begin(), get_removed_values_end(_undo_stack.back())}};
+                 {_removed_values.begin(), get_removed_values_end(_undo_stack.back())},
+                 {_old_fields.begin(), get_old_fields_end(_undo_stack.back())}};
       }
 
       auto begin() const { return get<0>().begin(); }
       auto end() const { return get<0>().end(); }
 
+      // Calls f with each object, in id order, as it was at revision, which must be in
+      // undo_stack_revision_range(). This reads the undo stack the way undo would apply it,
+      // without changing anything. Objects which changed since revision are passed as
+      // temporary copies.
+      template <typename F>
+      void for_each_at_revision(int64_t revision, F&& f) const
+      {
+         if (revision == _revision)
+         {
+            for (auto& obj : *this)
+               f(obj);
+            return;
+         }
+         auto& undo_info = undo_state_at(revision);
+
+         // Like undo, use the oldest backups made after revision
+         std::map<id_type, const value_type*> old_values;
+         for (auto it = _old_values.begin(), end = get_old_values_end(undo_info); it != end;
+              ++it)
+            if (to_old_node(*it)._mtime < undo_info.ctime)
+               old_values[it->id] = &*it;
+         std::map<id_type, const fields_backup*> old_fields;
+         if constexpr (has_undo_fields<T>)
+         {
+            for (auto it = _old_fields.begin(), end = get_old_fields_end(undo_info); it != end;
+                 ++it)
+               if (to_fields_node(*it)._mtime < undo_info.ctime)
+                  old_fields[it->id] = &*it;
+         }
+         std::map<id_type, const value_type*> removed;
+         for (auto it = _removed_values.begin(), end = get_removed_values_end(undo_info);
+              it != end; ++it)
+            if (it->id < undo_info.old_next_id)
+               removed[it->id] = &*it;
+
+         auto visit = [&](const value_type& obj) {
+            auto old_value = old_values.find(obj.id);
+            auto& value = old_value == old_values.end() ? obj : *old_value->second;
+            if constexpr (has_undo_fields<T>)
+            {
+               if (auto fields = old_fields.find(obj.id); fields != old_fields.end())
+               {
+                  value_type copy = value;
+                  copy.undo_fields() = fields->second->fields;
+                  f(std::as_const(copy));
+                  return;
+               }
+            }
+            f(value);
+         };
+         auto removed_it = removed.begin();
+         for (auto& obj : *this)
+         {
+            if (obj.id >= undo_info.old_next_id)
+               break;
+            for (; removed_it != removed.end() && removed_it->first < obj.id; ++removed_it)
+               visit(*removed_it->second);
+            visit(obj);
+         }
+         for (; removed_it != removed.end(); ++removed_it)
+            visit(*removed_it->second);
+      }
+
+      // The next_id at revision, which must be in undo_stack_revision_range()
+      id_type next_id_at_revision(int64_t revision) const
+      {
+         if (revision == _revision)
+            return _next_id;
+         return undo_state_at(revision).old_next_id;
+      }
+
       void undo_all()
       {
          while (!_undo_stack.empty())
@@ -757,6 +1504,7 @@ namespace chainbase
                    *iter = std::move(*p);
                    auto& node_mtime = to_node(*iter)._mtime;
                    node_mtime = restored_mtime;
+                   restore_fields_mtime(to_node(*iter), restored_mtime);
                    if (get_removed_field(*iter) != erased_flag)
                    {
                       // Non-unique items are transient and are guaranteed to be fixed
@@ -770,6 +1518,24 @@ namespace chainbase
                 }
                 dispose_old(*p);
              });
+         // replace old_fields, after old_values
+         _old_fields.erase_after_and_dispose(
+             _old_fields.before_begin(), get_old_fields_end(undo_info),
+             [this, &undo_info](fields_backup* p) {
+                if constexpr (has_undo_fields<T>)
+                {
+                   auto& backup = to_fields_node(*p);
+                   if (backup._mtime < undo_info.ctime)
+                   {
+                      auto& item = backup._current->_item;
+                      item.undo_fields() = std::move(p->fields);
+                      backup._current->_fields_mtime = backup._mtime;
+                      if (get_removed_field(item) != erased_flag)
+                         post_modify<false, 1>(item);
+                   }
+                }
+                dispose_fields(*p);
+             });
          // insert all removed_values
          _removed_values.erase_after_and_dispose(
              _removed_values.before_begin(), get_removed_values_end(undo_info),
@@ -819,6 +1585,15 @@ namespace chainbase
       void compress_last_undo_session() noexcept { compress_impl(_undo_stack.back()); }
 
      private:
+      // The undo state which restores revision
+      const undo_state& undo_state_at(int64_t revision) const
+      {
+         auto [first, last] = undo_stack_revision_range();
+         if (revision < first || revision >= last)
+            eosio::check(false, "revision is not on the undo stack");
+         return _undo_stack[revision - first];
+      }
+
       // Removes elements of the last undo session that would be redundant
       // if all the sessions after @c session were squashed.
       //
@@ -839,11 +1614,31 @@ namespace chainbase
                 {
                    item = std::move(v);
                    to_node(item)._mtime = to_old_node(v)._mtime;
+                   restore_fields_mtime(to_node(item), to_old_node(v)._mtime);
                    return true;
                 }
                 return false;
              },
              [&](pointer p) { dispose_old(*p); });
+         if constexpr (has_undo_fields<T>)
+         {
+            remove_if_after_and_dispose(
+                _old_fields, _old_fields.before_begin(), get_old_fields_end(_undo_stack.back()),
+                [session_start](fields_backup& v) {
+                   auto& backup = to_fields_node(v);
+                   if (backup._mtime >= session_start)
+                      return true;
+                   auto& item = backup._current->_item;
+                   if (get_removed_field(item) == erased_flag)
+                   {
+                      item.undo_fields() = std::move(v.fields);
+                      backup._current->_fields_mtime = backup._mtime;
+                      return true;
+                   }
+                   return false;
+                },
+                [&](fields_backup* p) { dispose_fields(*p); });
+         }
          remove_if_after_and_dispose(
              _removed_values, _removed_values.before_begin(),
              get_removed_values_end(_undo_stack.back()),
@@ -859,11 +1654,18 @@ namespace chainbase
          _undo_stack.back().old_values_end = _old_values.empty() ? nullptr : &*_old_values.begin();
          _undo_stack.back().removed_values_end =
              _removed_values.empty() ? nullptr : &*_removed_values.begin();
+         _undo_stack.back().old_fields_end = _old_fields.empty() ? nullptr : &*_old_fields.begin();
          _undo_stack.back().old_next_id = _next_id;
          _undo_stack.back().ctime = ++_monotonic_revision;
          return ++_revision;
       }
 
+      template <typename Index>
+      static const Allocator& index_allocator(const Allocator& a)
+      {
+         return a;
+      }
+
       template <int N = 0>
       bool insert_impl(value_type& p)
       {
@@ -890,37 +1692,45 @@ namespace chainbase
          if constexpr (N < sizeof...(Indices))
          {
             auto& idx = std::get<N>(_indices);
-            auto iter = idx.iterator_to(p);
-            bool fixup = false;
-            if (iter != idx.begin())
+            if constexpr (is_hashed_index<std::tuple_element_t<N, std::tuple<Indices...>>>)
             {
-               auto copy = iter;
-               --copy;
-               if (!idx.value_comp()(*copy, p))
-                  fixup = true;
+               if (!idx.post_modify(p, unique))
+                  return false;
             }
-            ++iter;
-            if (iter != idx.end())
-            {
-               if (!idx.value_comp()(p, *iter))
-                  fixup = true;
-            }
-            if (fixup)
+            else
             {
-               auto iter2 = idx.iterator_to(p);
-               idx.erase(iter2);
-               if constexpr (unique)
+               auto iter = idx.iterator_to(p);
+               bool fixup = false;
+               if (iter != idx.begin())
                {
-                  auto [new_pos, inserted] = idx.insert_unique(p);
-                  if (!inserted)
-                  {
-                     idx.insert_before(new_pos, p);
-                     return false;
-                  }
+                  auto copy = iter;
+                  --copy;
+                  if (!idx.value_comp()(*copy, p))
+                     fixup = true;
                }
-               else
+               ++iter;
+               if (iter != idx.end())
                {
-                  idx.insert_equal(p);
+                  if (!idx.value_comp()(p, *iter))
+                     fixup = true;
+               }
+               if (fixup)
+               {
+                  auto iter2 = idx.iterator_to(p);
+                  idx.erase(iter2);
+                  if constexpr (unique)
+                  {
+                     auto [new_pos, inserted] = idx.insert_unique(p);
+                     if (!inserted)
+                     {
+                        idx.insert_before(new_pos, p);
+                        return false;
+                     }
+                  }
+                  else
+                  {
+                     idx.insert_equal(p);
+                  }
                }
             }
             return post_modify<unique, N + 1>(p);
@@ -973,6 +1783,43 @@ namespace chainbase
          }
          return nullptr;
       }
+
+      // A full backup also covers the fields. Backups of the fields made after it may have
+      // been discarded as redundant, so _fields_mtime can't be trusted to be older.
+      static void restore_fields_mtime(node& n, uint64_t mtime) noexcept
+      {
+         if constexpr (has_undo_fields<T>)
+            n._fields_mtime = std::min(n._fields_mtime, mtime);
+      }
+
+      fields_backup* on_modify_fields(const value_type& obj)
+      {
+         if (!_undo_stack.empty())
+         {
+            auto& undo_info = _undo_stack.back();
+            auto& n = to_node(obj);
+            auto mtime = std::max(n._mtime, n._fields_mtime);
+            if (mtime >= undo_info.ctime)
+            {
+               // Nothing to do
+            }
+            else
+            {
+               auto p = fields_alloc_traits::allocate(_old_fields_allocator, 1);
+               auto guard0 = scope_exit{[&] { _old_fields_allocator.deallocate(p, 1); }};
+               fields_alloc_traits::construct(
+                   _old_fields_allocator, &*p,
+                   fields_backup{obj.id, undo_fields_t<T>(n._item.undo_fields())});
+               p->_mtime = mtime;
+               p->_current = &n;
+               guard0.cancel();
+               _old_fields.push_front(p->_item);
+               n._fields_mtime = _monotonic_revision;
+               return &p->_item;
+            }
+         }
+         return nullptr;
+      }
       template <int N = 0>
       void clear_impl() noexcept
       {
@@ -1004,8 +1851,15 @@ namespace chainbase
          dispose_old(static_cast<old_node&>(*boost::intrusive::get_parent_from_member(
              &node_ref, &value_holder<value_type>::_item)));
       }
+      void dispose_fields(fields_backup& backup) noexcept
+      {
+         fields_node* p{&to_fields_node(backup)};
+         fields_alloc_traits::destroy(_old_fields_allocator, p);
+         fields_alloc_traits::deallocate(_old_fields_allocator, p, 1);
+      }
       void dispose(typename list_base<old_node, index0_type>::iterator old_start,
-                   typename list_base<node, index0_type>::iterator removed_start) noexcept
+                   typename list_base<node, index0_type>::iterator removed_start,
+                   typename list_base<fields_node, index0_type>::iterator fields_start) noexcept
       {
          // This will leave one element around.  That's okay, because we'll clean it up the next time.
          if (old_start != _old_values.end())
@@ -1014,11 +1868,16 @@ namespace chainbase
          if (removed_start != _removed_values.end())
             _removed_values.erase_after_and_dispose(removed_start, _removed_values.end(),
                                                     [this](pointer p) { dispose_node(*p); });
+         if (fields_start != _old_fields.end())
+            _old_fields.erase_after_and_dispose(
+                fields_start, _old_fields.end(),
+                [this](fields_backup* p) { dispose_fields(*p); });
       }
       void dispose_undo() noexcept
       {
          _old_values.clear_and_dispose([this](pointer p) { dispose_old(*p); });
          _removed_values.clear_and_dispose([this](pointer p) { dispose_node(*p); });
+         _old_fields.clear_and_dispose([this](fields_backup* p) { dispose_fields(*p); });
       }
       static node& to_node(value_type& obj)
       {
@@ -1031,6 +1890,19 @@ namespace chainbase
          return static_cast<old_node&>(
              *boost::intrusive::get_parent_from_member(&obj, &value_holder<value_type>::_item));
       }
+      static const old_node& to_old_node(const value_type& obj)
+      {
+         return to_old_node(const_cast<value_type&>(obj));
+      }
+      static fields_node& to_fields_node(fields_backup& backup)
+      {
+         return static_cast<fields_node&>(*boost::intrusive::get_parent_from_member(
+             &backup, &value_holder<fields_backup>::_item));
+      }
+      static const fields_node& to_fields_node(const fields_backup& backup)
+      {
+         return to_fields_node(const_cast<fields_backup&>(backup));
+      }
 
       auto get_old_values_end(const undo_state& info)
       {
@@ -1050,6 +1922,24 @@ namespace chainbase
              const_cast<undo_index*>(this)->get_old_values_end(info));
       }
 
+      auto get_old_fields_end(const undo_state& info)
+      {
+         if (info.old_fields_end == nullptr)
+         {
+            return _old_fields.end();
+         }
+         else
+         {
+            return _old_fields.iterator_to(*info.old_fields_end);
+         }
+      }
+
+      auto get_old_fields_end(const undo_state& info) const
+      {
+         return static_cast<decltype(_old_fields.cend())>(
+             const_cast<undo_index*>(this)->get_old_fields_end(info));
+      }
+
       auto get_removed_values_end(const undo_state& info)
       {
          if (info.removed_values_end == nullptr)
@@ -1092,12 +1982,16 @@ namespace chainbase
       }
       using old_alloc_traits =
           typename std::allocator_traits<Allocator>::template rebind_traits<old_node>;
+      using fields_alloc_traits =
+          typename std::allocator_traits<Allocator>::template rebind_traits<fields_node>;
       indices_type _indices;
       boost::container::deque<undo_state, rebind_alloc_t<Allocator, undo_state>> _undo_stack;
       list_base<old_node, index0_type> _old_values;
       list_base<node, index0_type> _removed_values;
+      list_base<fields_node, index0_type> _old_fields;
       rebind_alloc_t<Allocator, node> _allocator;
       rebind_alloc_t<Allocator, old_node> _old_values_allocator;
+      rebind_alloc_t<Allocator, fields_node> _old_fields_allocator;
       id_type _next_id = 0;
       int64_t _revision = 0;
       uint64_t _monotonic_revision = 0;
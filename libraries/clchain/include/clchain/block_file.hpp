@@ -0,0 +1,161 @@
+#pragma once
+
+#include <clchain/subchain.hpp>
+#include <eosio/check.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+namespace subchain
+{
+   // Keeps archived blocks in a pair of append-only files, so a native process can serve
+   // history without holding it in memory. Not available in wasm.
+   //
+   // path holds the serialized blocks back to back. path + ".index" holds a header followed
+   // by the end offset of each block in path, so reading a block costs 2 reads. Blocks are
+   // written before their index entries; if a process dies during an append, opening the
+   // files again drops whatever the index doesn't fully cover.
+   class block_file : public block_archive
+   {
+     public:
+      // Opens the files, creating them if needed
+      explicit block_file(const std::filesystem::path& path)
+          : _path(path), _index_path(path.string() + ".index")
+      {
+         _data = open(_path);
+         _index = open(_index_path);
+         auto index_size = std::filesystem::file_size(_index_path);
+         if (index_size < sizeof(header))
+         {
+            write_at(_index, 0, &_header, sizeof(_header));
+            index_size = sizeof(header);
+         }
+         else
+         {
+            read_at(_index, 0, &_header, sizeof(_header));
+            eosio::check(_header.magic == header{}.magic,
+                         _index_path.string() + " is not a block index");
+            eosio::check(_header.version == header{}.version,
+                         _index_path.string() + " has an unsupported version");
+         }
+
+         uint32_t count = (index_size - sizeof(header)) / sizeof(uint64_t);
+         auto data_size = std::filesystem::file_size(_path);
+         while (count && end_offset(count - 1) > data_size)
+            --count;
+         _data_size = count ? end_offset(count - 1) : 0;
+         std::fflush(_data);
+         std::fflush(_index);
+         std::filesystem::resize_file(_path, _data_size);
+         std::filesystem::resize_file(_index_path, sizeof(header) + count * sizeof(uint64_t));
+         _first_num.store(_header.first_num);
+         _count.store(count);
+      }
+
+      block_file(const block_file&) = delete;
+      block_file& operator=(const block_file&) = delete;
+
+      ~block_file()
+      {
+         std::fclose(_index);
+         std::fclose(_data);
+      }
+
+      uint32_t begin_num() const override { return _count.load() ? _first_num.load() : 0; }
+      uint32_t end_num() const override
+      {
+         auto count = _count.load();
+         return count ? _first_num.load() + count : 0;
+      }
+
+      void append(const block_with_bin& block) override
+      {
+         auto count = _count.load();
+         eosio::check(!count || block.num == _header.first_num + count,
+                      "block " + std::to_string(block.num) + " leaves a gap in " +
+                          _path.string() + ", which ends at " + std::to_string(end_num()));
+         std::lock_guard lock{_mutex};
+         if (!count)
+         {
+            _header.first_num = block.num;
+            write_at(_index, 0, &_header, sizeof(_header));
+            _first_num.store(block.num);
+         }
+         write_at(_data, _data_size, block.bin.data(), block.bin.size());
+         std::fflush(_data);
+         _data_size += block.bin.size();
+         write_at(_index, sizeof(header) + count * sizeof(uint64_t), &_data_size,
+                  sizeof(_data_size));
+         std::fflush(_index);
+         _count.store(count + 1);
+      }
+
+      std::vector<char> read(uint32_t num) const override
+      {
+         auto count = _count.load();
+         auto first_num = _first_num.load();
+         if (num < first_num || num - first_num >= count)
+            return {};
+         auto i = num - first_num;
+         std::lock_guard lock{_mutex};
+         uint64_t begin = i ? end_offset(i - 1) : 0;
+         std::vector<char> result(end_offset(i) - begin);
+         read_at(_data, begin, result.data(), result.size());
+         return result;
+      }
+
+     private:
+      struct header
+      {
+         uint32_t magic = 0x6b636f6c;  // "lock"
+         uint32_t version = 0;
+         uint32_t first_num = 0;
+         uint32_t reserved = 0;
+      };
+
+      static std::FILE* open(const std::filesystem::path& path)
+      {
+         auto* file = std::fopen(path.c_str(), "r+b");
+         if (!file)
+            file = std::fopen(path.c_str(), "w+b");
+         eosio::check(file, "can not open " + path.string());
+         return file;
+      }
+
+      void read_at(std::FILE* file, uint64_t pos, void* data, std::size_t size) const
+      {
+         eosio::check(!std::fseek(file, pos, SEEK_SET) && std::fread(data, size, 1, file) == 1,
+                      "error reading " + _path.string());
+      }
+
+      void write_at(std::FILE* file, uint64_t pos, const void* data, std::size_t size)
+      {
+         eosio::check(!std::fseek(file, pos, SEEK_SET) && std::fwrite(data, size, 1, file) == 1,
+                      "error writing " + _path.string());
+      }
+
+      uint64_t end_offset(uint32_t i) const
+      {
+         uint64_t result;
+         read_at(_index, sizeof(header) + i * sizeof(uint64_t), &result, sizeof(result));
+         return result;
+      }
+
+      std::filesystem::path _path;
+      std::filesystem::path _index_path;
+      std::FILE* _data = nullptr;
+      std::FILE* _index = nullptr;
+      header _header;  // only append and the constructor use it
+      uint64_t _data_size = 0;
+
+      // Readers load _count, then _first_num. append stores them in the opposite order, so
+      // a reader which sees a block also sees where the file starts.
+      std::atomic<uint32_t> _first_num = 0;
+      std::atomic<uint32_t> _count = 0;
+      mutable std::mutex _mutex;
+   };
+}  // namespace subchain
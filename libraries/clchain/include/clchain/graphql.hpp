@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cctype>
 #include <charconv>
 #include <eosio/asset.hpp>
@@ -12,12 +13,17 @@
 #include <eosio/stream.hpp>
 #include <eosio/time.hpp>
 #include <eosio/types.hpp>
+#include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <typeindex>
+#include <utility>
 
 namespace clchain
 {
-   struct gql_stream;
+   struct gql_field;
+   struct gql_context;
 }
 
 namespace eosio
@@ -51,7 +57,8 @@ namespace eosio
 
    template <typename T, typename OS, typename E>
    auto gql_query(const T& value,
-                  clchain::gql_stream& input_stream,
+                  const clchain::gql_field& field,
+                  clchain::gql_context& context,
                   OS& output_stream,
                   const E& error) -> std::enable_if_t<use_json_string_for_gql((T*)nullptr), bool>
    {
@@ -247,6 +254,11 @@ namespace clchain
       char current_puncuator = 0;
 
       gql_stream(eosio::input_stream input) : input{input} { skip(); }
+
+      // Holds a single token which was already read, e.g. a variable's value
+      gql_stream(token_type type, std::string_view value) : current_type{type}, current_value{value}
+      {
+      }
       gql_stream(const gql_stream&) = default;
       gql_stream& operator=(const gql_stream&) = default;
 
@@ -486,81 +498,543 @@ namespace clchain
       }
    }
 
-   template <int i, typename... Args, typename E, typename... Arg_names>
-   bool gql_parse_args(std::tuple<Args...>& args,
-                       bool filled[],
-                       bool& found,
-                       gql_stream& input_stream,
-                       const E& error,
-                       const char* arg_name,
-                       Arg_names... arg_names)
+   // Parses the value of the index'th arg
+   template <int i, typename... Args, typename E>
+   bool gql_parse_arg_at(std::tuple<Args...>& args,
+                         uint32_t index,
+                         gql_stream& input_stream,
+                         const E& error)
    {
-      constexpr bool is_optional =
-          eosio::is_std_optional<eosio::remove_cvref_t<decltype(std::get<i>(args))>>();
-      if (input_stream.current_value != arg_name)
-         return gql_parse_args<i + 1>(args, filled, found, input_stream, error, arg_names...);
-      input_stream.skip();
-      if (input_stream.current_puncuator != ':')
-         return error("expected :");
-      if (filled[i])
-         return error("duplicate arg");
-      input_stream.skip();
-      if constexpr (is_optional)
+      if constexpr (i < sizeof...(Args))
       {
-         if (input_stream.current_type == gql_stream::name && input_stream.current_value == "null")
-            input_stream.skip();
+         if (index != i)
+            return gql_parse_arg_at<i + 1>(args, index, input_stream, error);
+         auto& arg = std::get<i>(args);
+         if constexpr (eosio::is_std_optional<eosio::remove_cvref_t<decltype(arg)>>())
+         {
+            if (input_stream.current_type == gql_stream::name &&
+                input_stream.current_value == "null")
+            {
+               arg.reset();
+               input_stream.skip();
+               return true;
+            }
+            arg.emplace();
+            return gql_parse_arg(*arg, input_stream, error);
+         }
          else
+            return gql_parse_arg(arg, input_stream, error);
+      }
+      else
+         return error("arg index out of range");
+   }
+
+   struct gql_token
+   {
+      gql_stream::token_type type = gql_stream::unstarted;
+      std::string_view value;
+   };
+
+   struct gql_variable
+   {
+      std::string_view name;
+      bool non_null = false;
+      gql_token default_value;
+   };
+
+   // A selected field. Method args are parsed when the query is compiled, except args bound to
+   // variables; those are parsed each time the plan runs.
+   struct gql_field
+   {
+      std::string_view alias;
+      uint32_t index = 0;                                    // position in the type's reflection
+      std::shared_ptr<const void> args;                      // tuple of method args
+      std::vector<std::pair<uint32_t, uint32_t>> bindings;  // arg index, variable index
+      std::vector<gql_field> selection;
+      bool is_list = false;
+      uint32_t page_size = 0;  // most items a paged field (e.g. a connection) can return
+   };
+
+   // A compiled query. It refers into its own copy of the query text, so it can't be copied.
+   struct gql_plan
+   {
+      std::string query;
+      std::vector<gql_variable> variables;
+      gql_field root;
+      uint64_t cost = 0;  // estimated upper bound of the number of values the query produces
+
+      gql_plan() = default;
+      gql_plan(const gql_plan&) = delete;
+      gql_plan& operator=(const gql_plan&) = delete;
+   };
+
+   // Bounds the work a single query may do
+   struct gql_limits
+   {
+      uint64_t max_cost = 100'000'000;  // limit on gql_plan::cost, which is pessimistic
+      uint64_t max_steps = 1'000'000;   // limit on fields and list items actually visited
+   };
+
+   // Page sizes of a paged type. Types declare theirs by overloading get_gql_page_limits.
+   struct gql_page_limits
+   {
+      uint32_t default_page_size = 0;  // 0 if unsized queries get every item
+      uint32_t max_page_size = 0;      // 0 if the type isn't paged
+   };
+
+   constexpr gql_page_limits get_gql_page_limits(const void*) { return {}; }
+
+   // Cost estimate for lists which aren't paged, or which are paged without a size
+   constexpr uint32_t gql_unpaged_list_size = 100;
+
+   // State for a single run of a plan
+   struct gql_context
+   {
+      std::vector<gql_token> variables;
+      uint64_t steps_left = 0;
+   };
+
+   template <typename E>
+   bool gql_step(gql_context& context, const E& error)
+   {
+      if (!context.steps_left)
+         return error("query exceeded its step budget");
+      --context.steps_left;
+      return true;
+   }
+
+   template <typename Raw, typename E>
+   bool gql_compile_selection(Raw*,
+                              gql_stream& input_stream,
+                              const gql_plan& plan,
+                              gql_field& field,
+                              const E& error);
+
+   template <typename T, typename E, typename... Arg_names>
+   bool gql_compile_args(gql_stream& input_stream,
+                         const gql_plan& plan,
+                         gql_field& field,
+                         const E& error,
+                         Arg_names... arg_names)
+   {
+      using mf = eosio::member_fn<T>;
+      using args_type = eosio::tuple_from_type_list<typename mf::arg_types>;
+      auto args = std::make_shared<args_type>();
+      bool filled[mf::num_args] = {};
+      if (input_stream.current_puncuator == '(')
+      {
+         input_stream.skip();
+         if (input_stream.current_puncuator == ')')
+            return error("empty arg list");
+         while (input_stream.current_type == gql_stream::name)
          {
-            std::get<i>(args).emplace();
-            if (!gql_parse_arg(*std::get<i>(args), input_stream, error))
+            uint32_t arg_index = 0;
+            if constexpr (mf::num_args > 0)
+               while (arg_index < mf::num_args &&
+                      input_stream.current_value != std::data({arg_names...})[arg_index])
+                  ++arg_index;
+            if (arg_index >= mf::num_args)
+               return error("unknown arg '" + (std::string)input_stream.current_value + "'");
+            input_stream.skip();
+            if (input_stream.current_puncuator != ':')
+               return error("expected :");
+            if (filled[arg_index])
+               return error("duplicate arg");
+            input_stream.skip();
+            if (input_stream.current_puncuator == '$')
+            {
+               input_stream.skip();
+               auto it = std::find_if(
+                   plan.variables.begin(), plan.variables.end(),
+                   [&](auto& v) { return v.name == input_stream.current_value; });
+               if (input_stream.current_type != gql_stream::name || it == plan.variables.end())
+                  return error("undefined variable $" + (std::string)input_stream.current_value);
+               field.bindings.push_back({arg_index, it - plan.variables.begin()});
+               input_stream.skip();
+            }
+            else if (!gql_parse_arg_at<0>(*args, arg_index, input_stream, error))
                return false;
+            filled[arg_index] = true;
          }
+         if (input_stream.current_puncuator != ')')
+            return error("expected )");
+         input_stream.skip();
       }
-      else if (!gql_parse_arg(std::get<i>(args), input_stream, error))
-         return false;
-      filled[i] = true;
-      found = true;
+      gql_mark_optional<0>(*args, filled);
+      if constexpr (mf::num_args > 0)
+      {
+         for (int i = 0; i < mf::num_args; ++i)
+            if (!filled[i])
+               return error("function missing required arg '" +
+                            std::string(std::data({arg_names...})[i]) + "'");
+
+         // Size the page using first and last. Variables may hold anything up to the maximum.
+         using ret = eosio::remove_cvref_t<typename mf::return_type>;
+         auto limits = get_gql_page_limits((ret*)nullptr);
+         if (limits.max_page_size)
+         {
+            bool sized = false;
+            uint32_t size = limits.max_page_size;
+            [&]<size_t... I>(std::index_sequence<I...>) {
+               (
+                   [&] {
+                      using arg_type = std::tuple_element_t<I, args_type>;
+                      std::string_view name = std::data({arg_names...})[I];
+                      if constexpr (std::is_same_v<arg_type, std::optional<uint32_t>>)
+                      {
+                         if (name != "first" && name != "last")
+                            return;
+                         if (std::any_of(field.bindings.begin(), field.bindings.end(),
+                                         [](auto& b) { return b.first == I; }))
+                            sized = true;
+                         else if (auto& value = std::get<I>(*args))
+                         {
+                            sized = true;
+                            size = std::min(size, *value);
+                         }
+                      }
+                   }(),
+                   ...);
+            }(std::make_index_sequence<mf::num_args>{});
+            field.page_size = sized ? size : std::min(limits.default_page_size, size);
+         }
+      }
+      field.args = std::move(args);
       return true;
    }
 
-   template <int i, typename... Args, typename E>
-   bool gql_parse_args(std::tuple<Args...>& args,
-                       bool filled[],
-                       bool& found,
-                       gql_stream& input_stream,
-                       const E& error)
+   // Members of T which queries may select, sorted by name, with their reflection index.
+   // Built on first use.
+   template <typename T>
+   const std::vector<std::pair<std::string_view, uint32_t>>& gql_field_names()
    {
-      static_assert(i == sizeof...(Args), "mismatched arg names");
-      return true;
+      static const auto names = [] {
+         std::vector<std::pair<std::string_view, uint32_t>> names;
+         uint32_t index = 0;
+         eosio_for_each_field((T*)nullptr, [&](std::string_view name, auto&& member, auto...) {
+            using member_type = decltype(member((T*)nullptr));
+            if constexpr (!eosio::is_non_const_member_fn<member_type>())
+               names.push_back({name, index});
+            ++index;
+         });
+         std::stable_sort(names.begin(), names.end(),
+                          [](auto& a, auto& b) { return a.first < b.first; });
+         return names;
+      }();
+      return names;
    }
 
-   template <typename E>
-   bool gql_skip_selection_set(gql_stream& input_stream, const E& error)
+   template <typename T, typename E>
+   bool gql_compile_object(gql_stream& input_stream,
+                           const gql_plan& plan,
+                           gql_field& field,
+                           const E& error)
    {
       if (input_stream.current_puncuator != '{')
+         return error("expected {");
+      input_stream.skip();
+      while (input_stream.current_type == gql_stream::name)
+      {
+         auto& selected = field.selection.emplace_back();
+         selected.alias = input_stream.current_value;
+         auto field_name = selected.alias;
+         input_stream.skip();
+         if (input_stream.current_puncuator == ':')
+         {
+            input_stream.skip();
+            if (input_stream.current_type != gql_stream::name)
+               return error("expected name after :");
+            field_name = input_stream.current_value;
+            input_stream.skip();
+         }
+         auto& names = gql_field_names<T>();
+         auto it = std::lower_bound(names.begin(), names.end(), field_name,
+                                    [](auto& a, auto& b) { return a.first < b; });
+         if (it == names.end() || it->first != field_name)
+            return error((std::string)field_name + " not found");
+         selected.index = it->second;
+         bool ok = true;
+         uint32_t index = 0;
+         eosio_for_each_field((T*)nullptr, [&](std::string_view, auto&& member, auto... arg_names) {
+            using member_type = decltype(member((T*)nullptr));
+            if (index++ != selected.index)
+               return;
+            if constexpr (std::is_member_object_pointer_v<member_type>)
+            {
+               using type = decltype(std::declval<const T&>().*member((T*)nullptr));
+               ok = gql_compile_selection((eosio::remove_cvref_t<type>*)nullptr, input_stream, plan,
+                                          selected, error);
+            }
+            else if constexpr (!eosio::is_non_const_member_fn<member_type>())
+            {
+               using mf = eosio::member_fn<member_type>;
+               using ret = eosio::remove_cvref_t<typename mf::return_type>;
+               ok = gql_compile_args<member_type>(input_stream, plan, selected, error,
+                                                  arg_names...) &&
+                    gql_compile_selection((ret*)nullptr, input_stream, plan, selected, error);
+            }
+         });
+         if (!ok)
+            return false;
+      }
+      if (input_stream.current_puncuator != '}')
+         return error("expected }");
+      input_stream.skip();
+      return true;
+   }
+
+   // Compiles the selection set (if any) which follows a field of type Raw
+   template <typename Raw, typename E>
+   bool gql_compile_selection(Raw*,
+                              gql_stream& input_stream,
+                              const gql_plan& plan,
+                              gql_field& field,
+                              const E& error)
+   {
+      using T = eosio::remove_cvref_t<Raw>;
+      if constexpr (has_get_gql_name<T>::value)
+         return true;
+      else if constexpr (eosio::is_std_optional<T>())
+         return gql_compile_selection((typename T::value_type*)nullptr, input_stream, plan, field,
+                                      error);
+      else if constexpr (std::is_pointer<T>())
+         return gql_compile_selection((std::remove_const_t<std::remove_pointer_t<T>>*)nullptr,
+                                      input_stream, plan, field, error);
+      else if constexpr (eosio::is_std_unique_ptr<T>())
+         return gql_compile_selection((typename T::element_type*)nullptr, input_stream, plan,
+                                      field, error);
+      else if constexpr (eosio::is_std_reference_wrapper<T>())
+         return gql_compile_selection((typename T::type*)nullptr, input_stream, plan, field,
+                                      error);
+      else if constexpr (eosio::is_serializable_container<T>())
+      {
+         field.is_list = true;
+         return gql_compile_selection((typename T::value_type*)nullptr, input_stream, plan, field,
+                                      error);
+      }
+      else if constexpr (eosio::reflection::has_for_each_field_v<T>)
+         return gql_compile_object<T>(input_stream, plan, field, error);
+      else
          return true;
+   }
+
+   template <typename E>
+   bool gql_compile_variables(gql_stream& input_stream, gql_plan& plan, const E& error)
+   {
       input_stream.skip();
-      while (true)
+      while (input_stream.current_puncuator == '$')
       {
-         if (input_stream.current_type == gql_stream::eof)
-            return error("expected }");
-         else if (input_stream.current_puncuator == '{')
+         input_stream.skip();
+         if (input_stream.current_type != gql_stream::name)
+            return error("expected variable name");
+         auto& variable = plan.variables.emplace_back();
+         variable.name = input_stream.current_value;
+         for (size_t i = 0; i + 1 < plan.variables.size(); ++i)
+            if (plan.variables[i].name == variable.name)
+               return error("duplicate variable $" + (std::string)variable.name);
+         input_stream.skip();
+         if (input_stream.current_puncuator != ':')
+            return error("expected :");
+         input_stream.skip();
+         int depth = 0;
+         for (; input_stream.current_puncuator == '['; ++depth)
+            input_stream.skip();
+         if (input_stream.current_type != gql_stream::name)
+            return error("expected type name");
+         input_stream.skip();
+         for (; depth; --depth)
          {
-            if (!gql_skip_selection_set(input_stream, error))
-               return false;
+            if (input_stream.current_puncuator == '!')
+               input_stream.skip();
+            if (input_stream.current_puncuator != ']')
+               return error("expected ]");
+            input_stream.skip();
          }
-         else if (input_stream.current_puncuator == '}')
+         if (input_stream.current_puncuator == '!')
          {
+            variable.non_null = true;
             input_stream.skip();
-            return true;
          }
+         if (input_stream.current_puncuator == '=')
+         {
+            input_stream.skip();
+            if (input_stream.current_type != gql_stream::name &&
+                input_stream.current_type != gql_stream::string &&
+                input_stream.current_type != gql_stream::integer &&
+                input_stream.current_type != gql_stream::floating)
+               return error("expected default value");
+            variable.default_value = {input_stream.current_type, input_stream.current_value};
+            input_stream.skip();
+         }
+      }
+      if (input_stream.current_puncuator != ')')
+         return error("expected )");
+      input_stream.skip();
+      return true;
+   }
+
+   // Estimates the number of values field produces for each value of its parent. A list
+   // produces a page of items if it or its parent (e.g. a connection) has a page size,
+   // otherwise gql_unpaged_list_size items.
+   inline uint64_t gql_estimate_cost(const gql_field& field, uint32_t parent_page_size)
+   {
+      constexpr uint64_t max_cost = uint64_t(1) << 48;
+      uint64_t cost = 1;
+      for (auto& child : field.selection)
+         cost = std::min(cost + gql_estimate_cost(child, field.page_size), max_cost);
+      if (field.is_list)
+      {
+         uint64_t items = field.page_size      ? field.page_size
+                          : parent_page_size ? parent_page_size
+                                             : gql_unpaged_list_size;
+         cost = cost > max_cost / items ? max_cost : cost * items;
+      }
+      return cost;
+   }
+
+   // Compiles query into plan. Plans are tied to the root type T.
+   template <typename T, typename E>
+   bool gql_compile(T*, gql_plan& plan, std::string_view query, const E& error)
+   {
+      plan.query = query;
+      gql_stream input_stream{std::string_view{plan.query}};
+      if (input_stream.current_type == gql_stream::name)
+      {
+         if (input_stream.current_value == "query")
+         {
+            input_stream.skip();
+            if (input_stream.current_type == gql_stream::name)
+               input_stream.skip();
+            if (input_stream.current_puncuator == '(' &&
+                !gql_compile_variables(input_stream, plan, error))
+               return false;
+            if (input_stream.current_puncuator == '@')
+               return error("directives not supported");
+         }
+         else if (input_stream.current_value == "subscriptions")
+            return error("subscriptions not supported");
+         else if (input_stream.current_value == "mutation")
+            return error("mutations not supported");
+         else if (input_stream.current_value == "fragment")
+            return error("fragments not supported");
          else
+            return error("expected query");
+      }
+      if (!gql_compile_object<T>(input_stream, plan, plan.root, error))
+         return false;
+      plan.cost = gql_estimate_cost(plan.root, 0);
+      if (input_stream.current_type == gql_stream::eof)
+         return true;
+      if (input_stream.current_type == gql_stream::name)
+      {
+         if (input_stream.current_value == "query")
+            return error("multiple queries not supported");
+         if (input_stream.current_value == "fragment")
+            return error("fragments not supported");
+         if (input_stream.current_value == "subscription")
+            return error("subscriptions not supported");
+         if (input_stream.current_value == "mutation")
+            return error("mutations not supported");
+      }
+      return error("expected end of input");
+   }
+
+   // Binds the variables JSON object to the plan's variables. Only scalar values are supported.
+   template <typename E>
+   bool gql_bind_variables(const gql_plan& plan,
+                           std::string_view variables,
+                           gql_context& context,
+                           const E& error)
+   {
+      context.variables.assign(plan.variables.size(), {});
+      gql_stream input_stream{variables};
+      if (input_stream.current_puncuator == '{')
+      {
+         input_stream.skip();
+         while (input_stream.current_type == gql_stream::string)
+         {
+            auto name = input_stream.current_value;
+            input_stream.skip();
+            if (input_stream.current_puncuator != ':')
+               return error("expected : in variables");
+            input_stream.skip();
+            if (input_stream.current_type != gql_stream::name &&
+                input_stream.current_type != gql_stream::string &&
+                input_stream.current_type != gql_stream::integer &&
+                input_stream.current_type != gql_stream::floating)
+               return error("variable values must be scalars");
+            for (size_t i = 0; i < plan.variables.size(); ++i)
+               if (plan.variables[i].name == name)
+                  context.variables[i] = {input_stream.current_type, input_stream.current_value};
             input_stream.skip();
+         }
+         if (input_stream.current_puncuator != '}')
+            return error("expected } in variables");
+         input_stream.skip();
+      }
+      else if (input_stream.current_type == gql_stream::name &&
+               input_stream.current_value == "null")
+         input_stream.skip();
+      if (input_stream.current_type != gql_stream::eof)
+         return error("variables must be a JSON object");
+      for (size_t i = 0; i < plan.variables.size(); ++i)
+      {
+         auto& value = context.variables[i];
+         if (value.type == gql_stream::unstarted)
+            value = plan.variables[i].default_value;
+         if (value.type == gql_stream::unstarted)
+         {
+            if (plan.variables[i].non_null)
+               return error("missing variable $" + (std::string)plan.variables[i].name);
+            value = {gql_stream::name, "null"};
+         }
       }
+      return true;
    }
 
+   // Compiled plans, keyed by query text. The least-recently used plan is dropped when the cache
+   // is full. T is the root type the plans were compiled for.
+   template <typename T>
+   struct gql_plan_cache
+   {
+      size_t capacity;
+      gql_limits limits;
+      std::list<gql_plan> plans;  // most-recently used first
+      std::map<std::string_view, typename std::list<gql_plan>::iterator> by_query;
+
+      explicit gql_plan_cache(size_t capacity) : capacity{capacity} {}
+
+      template <typename E>
+      const gql_plan* get(std::string_view query, const E& error)
+      {
+         auto it = by_query.find(query);
+         if (it != by_query.end())
+         {
+            plans.splice(plans.begin(), plans, it->second);
+            return &plans.front();
+         }
+         auto& plan = plans.emplace_front();
+         if (!gql_compile((T*)nullptr, plan, query, error))
+         {
+            plans.pop_front();
+            return nullptr;
+         }
+         by_query.insert({plan.query, plans.begin()});
+         if (plans.size() > capacity)
+         {
+            by_query.erase(plans.back().query);
+            plans.pop_back();
+         }
+         return &plan;
+      }
+   };
+
    template <typename T, typename OS, typename E>
-   auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   auto gql_query(const T& value,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
        -> std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, std::string>, bool>
    {
       eosio::to_json(value, output_stream);
@@ -568,44 +1042,55 @@ namespace clchain
    }
 
    template <typename T, typename OS, typename E>
-   auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   auto gql_query(const T& value,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
        -> std::enable_if_t<eosio::is_std_optional<T>() || std::is_pointer<T>() ||
                                eosio::is_std_unique_ptr<T>(),
                            bool>
    {
       if (value)
-         return gql_query(*value, input_stream, output_stream, error);
+         return gql_query(*value, field, context, output_stream, error);
       write_str("null", output_stream);
-      return gql_skip_selection_set(input_stream, error);
+      return true;
    }
 
    template <typename T, typename OS, typename E>
-   auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   auto gql_query(const T& value,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
        -> std::enable_if_t<eosio::is_std_reference_wrapper<T>::value, bool>
    {
-      return gql_query(value.get(), input_stream, output_stream, error);
+      return gql_query(value.get(), field, context, output_stream, error);
    }
 
    template <typename T, typename OS, typename E>
-   auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   auto gql_query(const T& value,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
        -> std::enable_if_t<eosio::is_serializable_container<T>::value, bool>
    {
       output_stream.write('[');
       bool first = true;
       for (auto& v : value)
       {
+         if (!gql_step(context, error))
+            return false;
          if (first)
             increase_indent(output_stream);
          else
             output_stream.write(',');
          write_newline(output_stream);
          first = false;
-         auto copy = input_stream;
-         if (!gql_query(v, copy, output_stream, error))
+         if (!gql_query(v, field, context, output_stream, error))
             return false;
       }
-      if (!gql_skip_selection_set(input_stream, error))
-         return false;
       if (!first)
       {
          decrease_indent(output_stream);
@@ -615,111 +1100,84 @@ namespace clchain
       return true;
    }
 
+   template <typename T, typename M, typename OS, typename E>
+   bool gql_query_member(const T& value,
+                         const gql_field& field,
+                         gql_context& context,
+                         OS& output_stream,
+                         const E& error)
+   {
+      if (!gql_step(context, error))
+         return false;
+      auto member = M{}((T*)nullptr);
+      if constexpr (std::is_member_object_pointer_v<decltype(member)>)
+         return gql_query(value.*member, field, context, output_stream, error);
+      else
+      {
+         using mf = eosio::member_fn<decltype(member)>;
+         using args_type = eosio::tuple_from_type_list<typename mf::arg_types>;
+         auto args = *static_cast<const args_type*>(field.args.get());
+         for (auto [arg_index, variable_index] : field.bindings)
+         {
+            auto& variable = context.variables[variable_index];
+            gql_stream input_stream{variable.type, variable.value};
+            if (!gql_parse_arg_at<0>(args, arg_index, input_stream, error))
+               return false;
+         }
+         auto result = std::apply(
+             [&](auto&&... args) { return (value.*member)(std::move(args)...); }, args);
+         return gql_query(result, field, context, output_stream, error);
+      }
+   }
+
+   // Jump table indexed by gql_field::index. Built on first use.
+   template <typename T, typename OS, typename E>
+   const auto& gql_member_queries()
+   {
+      using query_fn = bool (*)(const T&, const gql_field&, gql_context&, OS&, const E&);
+      static const auto queries = [] {
+         std::vector<query_fn> queries;
+         eosio_for_each_field((T*)nullptr, [&](std::string_view, auto&& member, auto...) {
+            using member_type = decltype(member((T*)nullptr));
+            if constexpr (eosio::is_non_const_member_fn<member_type>())
+               queries.push_back(nullptr);
+            else
+               queries.push_back(&gql_query_member<T, std::decay_t<decltype(member)>, OS, E>);
+         });
+         return queries;
+      }();
+      return queries;
+   }
+
    template <typename Raw, typename OS, typename E>
-   auto gql_query(const Raw& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   auto gql_query(const Raw& value,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
        -> std::enable_if_t<eosio::reflection::has_for_each_field_v<Raw> &&
                                !has_get_gql_name<Raw>::value,
                            bool>
    {
       using T = eosio::remove_cvref_t<Raw>;
-      if (input_stream.current_puncuator != '{')
-         return error("expected {");
-      input_stream.skip();
+      auto& queries = gql_member_queries<T, OS, E>();
       bool first = true;
       output_stream.write('{');
-      while (input_stream.current_type == gql_stream::name)
+      for (auto& selected : field.selection)
       {
-         bool found = false;
-         bool ok = true;
-         auto alias = input_stream.current_value;
-         auto field_name = alias;
-         input_stream.skip();
-         if (input_stream.current_puncuator == ':')
+         if (first)
          {
-            input_stream.skip();
-            if (input_stream.current_type != gql_stream::name)
-               return error("expected name after :");
-            field_name = input_stream.current_value;
-            input_stream.skip();
+            increase_indent(output_stream);
+            first = false;
          }
-         eosio_for_each_field((T*)nullptr, [&](std::string_view name, auto&& member,
-                                               auto... arg_names) {
-            using member_type = decltype(member((T*)nullptr));
-            if constexpr (eosio::is_non_const_member_fn<member_type>())
-               return;
-            else
-            {
-               if (found)
-                  return;
-               if (name == field_name)
-               {
-                  found = true;
-                  if (first)
-                  {
-                     increase_indent(output_stream);
-                     first = false;
-                  }
-                  else
-                     output_stream.write(',');
-                  write_newline(output_stream);
-                  to_json(alias, output_stream);
-                  write_colon(output_stream);
-                  if constexpr (std::is_member_object_pointer_v<member_type>)
-                  {
-                     if (!gql_query(value.*member(&value), input_stream, output_stream, error))
-                        ok = false;
-                  }
-                  else
-                  {
-                     using mf = eosio::member_fn<member_type>;
-                     eosio::tuple_from_type_list<typename mf::arg_types> args;
-                     bool filled[mf::num_args] = {};
-                     if (input_stream.current_puncuator == '(')
-                     {
-                        input_stream.skip();
-                        if (input_stream.current_puncuator == ')')
-                           return (ok = error("empty arg list")), void();
-                        while (input_stream.current_type == gql_stream::name)
-                        {
-                           bool found = false;
-                           if (!gql_parse_args<0>(args, filled, found, input_stream, error,
-                                                  arg_names...))
-                              return (ok = false), void();
-                           if (!found)
-                              return (ok = error("unknown arg '" +
-                                                 (std::string)input_stream.current_value + "'")),
-                                     void();
-                        }
-                        if (input_stream.current_puncuator != ')')
-                           return (ok = error("expected )")), void();
-                        input_stream.skip();
-                     }
-                     gql_mark_optional<0>(args, filled);
-                     if constexpr (mf::num_args > 0)
-                        for (int i = 0; i < mf::num_args; ++i)
-                           if (!filled[i])
-                              return (ok = error("function missing required arg '" +
-                                                 std::string(std::data({arg_names...})[i]) + "'")),
-                                     void();
-                     auto result = std::apply(
-                         [&](auto&&... args) {
-                            return (value.*member(&value))(std::move(args)...);
-                         },
-                         args);
-                     if (!gql_query(result, input_stream, output_stream, error))
-                        return (ok = false), void();
-                  }
-               }
-            }
-         });
-         if (!ok)
+         else
+            output_stream.write(',');
+         write_newline(output_stream);
+         to_json(selected.alias, output_stream);
+         write_colon(output_stream);
+         if (!queries[selected.index](value, selected, context, output_stream, error))
             return false;
-         if (!found)
-            return error((std::string)field_name + " not found");
       }
-      if (input_stream.current_puncuator != '}')
-         return error("expected }");
-      input_stream.skip();
       if (!first)
       {
          decrease_indent(output_stream);
@@ -729,102 +1187,99 @@ namespace clchain
       return true;
    }
 
-   template <typename T, typename OS, typename E>
-   bool gql_query_root(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   template <typename Stream>
+   std::string gql_error_result(const std::string& error)
    {
-      if (input_stream.current_type == gql_stream::name)
-      {
-         if (input_stream.current_value == "query")
-         {
-            input_stream.skip();
-            if (input_stream.current_type == gql_stream::name)
-               input_stream.skip();
-            if (input_stream.current_puncuator == '(')
-               return error("variables not supported");
-            if (input_stream.current_puncuator == '@')
-               return error("directives not supported");
-         }
-         else if (input_stream.current_value == "subscriptions")
-            return error("subscriptions not supported");
-         else if (input_stream.current_value == "mutation")
-            return error("mutations not supported");
-         else if (input_stream.current_value == "fragment")
-            return error("fragments not supported");
-         else
-            return error("expected query");
-      }
-      if (!gql_query(value, input_stream, output_stream, error))
-         return false;
-      if (input_stream.current_type == gql_stream::eof)
-         return true;
-      if (input_stream.current_type == gql_stream::name)
-      {
-         if (input_stream.current_value == "query")
-            return error("multiple queries not supported");
-         if (input_stream.current_value == "fragment")
-            return error("fragments not supported");
-         if (input_stream.current_value == "subscription")
-            return error("subscriptions not supported");
-         if (input_stream.current_value == "mutation")
-            return error("mutations not supported");
-      }
-      return error("expected end of input");
+      std::string result;
+      Stream error_stream(result);
+      error_stream.write('{');
+      increase_indent(error_stream);
+      write_newline(error_stream);
+      write_str("\"errors\": {", error_stream);
+      increase_indent(error_stream);
+      write_newline(error_stream);
+      write_str("\"message\": ", error_stream);
+      eosio::to_json(error, error_stream);
+      decrease_indent(error_stream);
+      write_newline(error_stream);
+      error_stream.write('}');
+      decrease_indent(error_stream);
+      write_newline(error_stream);
+      error_stream.write('}');
+      return result;
    }
 
    template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
-   std::string gql_query(const T& value, std::string_view query, std::string_view variables)
+   std::string gql_query(const T& value,
+                         const gql_plan& plan,
+                         std::string_view variables,
+                         const gql_limits& limits = {})
    {
-      gql_stream input_stream{query};
+      std::string error;
+      auto on_error = [&](const auto& e) {
+         error = e;
+         return false;
+      };
+      if (plan.cost > limits.max_cost)
+         return gql_error_result<Stream>("query is too expensive; estimated cost " +
+                                         std::to_string(plan.cost) + " exceeds " +
+                                         std::to_string(limits.max_cost));
+      gql_context context;
+      context.steps_left = limits.max_steps;
+      if (!gql_bind_variables(plan, variables, context, on_error))
+         return gql_error_result<Stream>(error);
       std::string result;
       Stream output_stream(result);
       output_stream.write('{');
       increase_indent(output_stream);
       write_newline(output_stream);
       write_str("\"data\": ", output_stream);
-      std::string error;
-      bool ok = true;
-      if (!variables.empty())
-      {
-         error = "variables not supported; argument must be empty";
-         ok = false;
-      }
-      else
-         ok = gql_query_root(value, input_stream, output_stream, [&](const auto& e) {
-            error = e;
-            return false;
-         });
-      if (!ok)
-      {
-         result.clear();
-         Stream error_stream(result);
-         error_stream.write('{');
-         increase_indent(error_stream);
-         write_newline(error_stream);
-         write_str("\"errors\": {", error_stream);
-         increase_indent(error_stream);
-         write_newline(error_stream);
-         write_str("\"message\": ", error_stream);
-         eosio::to_json(error, error_stream);
-         decrease_indent(error_stream);
-         write_newline(error_stream);
-         error_stream.write('}');
-         decrease_indent(error_stream);
-         write_newline(error_stream);
-         error_stream.write('}');
-         return result;
-      }
+      if (!gql_query(value, plan.root, context, output_stream, on_error))
+         return gql_error_result<Stream>(error);
       decrease_indent(output_stream);
       write_newline(output_stream);
       output_stream.write('}');
       return result;
    }
 
+   template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
+   std::string gql_query(const T& value,
+                         std::string_view query,
+                         std::string_view variables,
+                         const gql_limits& limits = {})
+   {
+      std::string error;
+      gql_plan plan;
+      if (!gql_compile((T*)nullptr, plan, query, [&](const auto& e) {
+             error = e;
+             return false;
+          }))
+         return gql_error_result<Stream>(error);
+      return gql_query<Stream>(value, plan, variables, limits);
+   }
+
+   template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
+   std::string gql_query(const T& value,
+                         gql_plan_cache<T>& cache,
+                         std::string_view query,
+                         std::string_view variables)
+   {
+      std::string error;
+      auto* plan = cache.get(query, [&](const auto& e) {
+         error = e;
+         return false;
+      });
+      if (!plan)
+         return gql_error_result<Stream>(error);
+      return gql_query<Stream>(value, *plan, variables, cache.limits);
+   }
+
    template <typename T>
    std::string format_gql_query(const T& value, std::string_view query)
    {
       return gql_query<
-          eosio::time_point_include_z_stream<eosio::pretty_stream<eosio::string_stream>>>(value,
-                                                                                          query);
+          eosio::time_point_include_z_stream<eosio::pretty_stream<eosio::string_stream>>>(
+          value, query, {});
    }
 }  // namespace clchain
 
@@ -4,24 +4,44 @@
 #include <eosio/from_bin.hpp>
 #include <eosio/reflection2.hpp>
 #include <eosio/to_bin.hpp>
+#include <functional>
+#include <iterator>
+#include <memory>
 
 namespace clchain
 {
+   // Encodes the cursor of a container element. Cursors are only encoded when a query
+   // selects them.
+   using CursorEncoder = std::function<std::string(const void* item)>;
+
    struct PageInfo
    {
       bool hasPreviousPage = false;
       bool hasNextPage = false;
-      std::string startCursor;
-      std::string endCursor;
+      std::shared_ptr<const CursorEncoder> encoder;
+      const void* startItem = nullptr;
+      const void* endItem = nullptr;
+      std::shared_ptr<const void> items;  // owns startItem and endItem, if they need an owner
+
+      std::string startCursor() const { return startItem ? (*encoder)(startItem) : ""; }
+      std::string endCursor() const { return endItem ? (*encoder)(endItem) : ""; }
    };
    EOSIO_REFLECT2(PageInfo, hasPreviousPage, hasNextPage, startCursor, endCursor)
 
-   template <typename T, const char* ConnectionName, const char* EdgeName>
+   // Queries which specify neither first nor last get DefaultPageSize edges, or every edge if
+   // it's 0. first and last are capped at MaxPageSize.
+   template <typename T,
+             const char* ConnectionName,
+             const char* EdgeName,
+             uint32_t DefaultPageSize = 0,
+             uint32_t MaxPageSize = 1000>
    struct ConnectionConfig
    {
       using value_type = T;
       static constexpr const char* connection_name = ConnectionName;
       static constexpr const char* edge_name = EdgeName;
+      static constexpr uint32_t default_page_size = DefaultPageSize;
+      static constexpr uint32_t max_page_size = MaxPageSize;
    };
 
    template <typename Config>
@@ -30,7 +50,10 @@ namespace clchain
       using config = Config;
 
       typename Config::value_type node;
-      std::string cursor;
+      const CursorEncoder* encoder = nullptr;
+      const void* item = nullptr;
+
+      std::string cursor() const { return (*encoder)(item); }
    };
    template <typename Config>
    [[maybe_unused]] inline const char* get_type_name(Edge<Config>*)
@@ -43,13 +66,28 @@ namespace clchain
       EOSIO_REFLECT2_FOR_EACH_FIELD(Edge<Config>, node, cursor)
    }
 
+   // A connection's edges. They're produced one at a time while the connection is being
+   // queried instead of being stored.
+   template <typename Config>
+   struct EdgeRange
+   {
+      using value_type = Edge<Config>;
+
+      // Calls f on each edge until it returns false. Returns false if f did.
+      std::function<bool(const std::function<bool(const Edge<Config>&)>& f)> for_each;
+   };
+
    template <typename Config>
    struct Connection
    {
       using config = Config;
 
-      std::vector<Edge<Config>> edges;
+      EdgeRange<Config> edges;
       PageInfo pageInfo;
+      std::function<uint32_t()> count;
+
+      // Number of elements within the connection's range, ignoring cursors and page sizes
+      uint32_t totalCount() const { return count ? count() : 0; }
    };
    template <typename Config>
    [[maybe_unused]] inline const char* get_type_name(Connection<Config>*)
@@ -59,10 +97,113 @@ namespace clchain
    template <typename Config, typename F>
    constexpr void eosio_for_each_field(Connection<Config>*, F f)
    {
-      EOSIO_REFLECT2_FOR_EACH_FIELD(Connection<Config>, edges, pageInfo)
+      EOSIO_REFLECT2_FOR_EACH_FIELD(Connection<Config>, edges, pageInfo, totalCount)
+   }
+   template <typename Config>
+   constexpr gql_page_limits get_gql_page_limits(Connection<Config>*)
+   {
+      return {Config::default_page_size, Config::max_page_size};
+   }
+
+   template <typename Config, typename OS, typename E>
+   bool gql_query(const EdgeRange<Config>& edges,
+                  const gql_field& field,
+                  gql_context& context,
+                  OS& output_stream,
+                  const E& error)
+   {
+      output_stream.write('[');
+      bool first = true;
+      if (!edges.for_each([&](const Edge<Config>& edge) {
+             if (first)
+                increase_indent(output_stream);
+             else
+                output_stream.write(',');
+             write_newline(output_stream);
+             first = false;
+             return gql_step(context, error) &&
+                    gql_query(edge, field, context, output_stream, error);
+          }))
+         return false;
+      if (!first)
+      {
+         decrease_indent(output_stream);
+         write_newline(output_stream);
+      }
+      output_stream.write(']');
+      return true;
+   }
+
+   // Containers with ranked indices (e.g. chainbase's ranked_unique) count and skip
+   // elements in O(log n). Other containers fall back to iterating unless their iterators
+   // are random access.
+   template <typename T>
+   concept ranked_container = requires(const T& container)
+   {
+      container.rank(container.begin());
+      container.nth(0);
+   };
+
+   // Iterators which hold their element, instead of referring to one in the container, set
+   // holds_element (e.g. views which merge several tables). Connections keep copies of them
+   // for pageInfo.
+   template <typename It>
+   concept element_holding_iterator = It::holds_element;
+
+   template <typename T, typename It>
+   uint32_t count_range(const T& container, It begin, It end)
+   {
+      if constexpr (ranked_container<T>)
+         return container.rank(end) - container.rank(begin);
+      else
+         return std::distance(begin, end);
    }
 
-   // To enable cursors to function correctly, container must not have duplicate keys
+   // Moves it forward by up to n elements, stopping at limit
+   template <typename T, typename It>
+   It advance_within(const T& container, It it, It limit, uint32_t n)
+   {
+      if constexpr (ranked_container<T>)
+         return container.nth(std::min(container.rank(it) + n, container.rank(limit)));
+      else if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                           typename std::iterator_traits<It>::iterator_category>)
+         return it + std::min<std::ptrdiff_t>(n, limit - it);
+      else
+      {
+         for (; it != limit && n > 0; --n)
+            ++it;
+         return it;
+      }
+   }
+
+   // Moves it back by up to n elements, stopping at limit
+   template <typename T, typename It>
+   It retreat_within(const T& container, It it, It limit, uint32_t n)
+   {
+      if constexpr (ranked_container<T>)
+      {
+         auto rank = container.rank(it);
+         auto limit_rank = container.rank(limit);
+         return container.nth(rank - std::min<std::size_t>(n, rank - limit_rank));
+      }
+      else if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                           typename std::iterator_traits<It>::iterator_category>)
+         return it - std::min<std::ptrdiff_t>(n, it - limit);
+      else
+      {
+         for (; it != limit && n > 0; --n)
+            --it;
+         return it;
+      }
+   }
+
+   // To enable cursors to function correctly, container must not have duplicate keys.
+   // to_key and to_node are called while the connection is queried, after make_connection
+   // returns, so they must not refer to the caller's locals. container must outlive the
+   // connection.
+   //
+   // offset skips that many elements after the after cursor, or before the before cursor
+   // when only last is given.
    template <typename Connection,
              typename Key,
              typename T,
@@ -78,6 +219,7 @@ namespace clchain
                               std::optional<uint32_t> last,
                               const std::optional<std::string>& before,
                               const std::optional<std::string>& after,
+                              std::optional<uint32_t> offset,
                               const T& container,
                               To_key&& to_key,
                               To_node&& to_node,
@@ -102,6 +244,14 @@ namespace clchain
          return {};
       };
 
+      using config = typename Connection::config;
+      if (!first && !last && config::default_page_size)
+         first = config::default_page_size;
+      if (first)
+         first = std::min(*first, config::max_page_size);
+      if (last)
+         last = std::min(*last, config::max_page_size);
+
       auto rangeBegin = container.begin();
       auto rangeEnd = container.end();
       if (ge)
@@ -121,41 +271,80 @@ namespace clchain
       if (auto key = key_from_hex(before))
          end = std::clamp(lower_bound(container, *key), rangeBegin, rangeEnd, compare_it);
       end = std::max(it, end, compare_it);
+      if (offset)
+      {
+         if (last && !first)
+            end = retreat_within(container, end, it, *offset);
+         else
+            it = advance_within(container, it, end, *offset);
+      }
 
+      auto page_begin = it;
+      auto page_end = end;
       Connection result;
-      auto add_edge = [&](const auto& it) {
-         auto bin = eosio::convert_to_bin(to_key(*it));
-         auto cursor = eosio::hex(bin.begin(), bin.end());
-         result.edges.push_back(Edge<typename Connection::config>{to_node(*it), std::move(cursor)});
-      };
-
       if (last && !first)
       {
-         result.pageInfo.hasNextPage = end != rangeEnd;
-         for (; it != end && (*last)-- > 0; --end)
-            add_edge(std::prev(end));
-         result.pageInfo.hasPreviousPage = end != rangeBegin;
-         std::reverse(result.edges.begin(), result.edges.end());
+         result.pageInfo.hasNextPage = page_end != rangeEnd;
+         page_begin = retreat_within(container, page_end, it, *last);
+         result.pageInfo.hasPreviousPage = page_begin != rangeBegin;
       }
       else
       {
          result.pageInfo.hasPreviousPage = it != rangeBegin;
-         for (; it != end && (!first || (*first)-- > 0); ++it)
-            add_edge(it);
-         result.pageInfo.hasNextPage = it != rangeEnd;
-         if (last && *last < result.edges.size())
+         uint32_t size = 0;
+         page_end = it;
+         for (; page_end != end && (!first || size < *first); ++page_end)
+            ++size;
+         result.pageInfo.hasNextPage = page_end != rangeEnd;
+         if (last && *last < size)
          {
             result.pageInfo.hasPreviousPage = true;
-            result.edges.erase(result.edges.begin(),
-                               result.edges.begin() + (result.edges.size() - *last));
+            page_begin = std::next(page_begin, size - *last);
          }
       }
 
-      if (!result.edges.empty())
+      using item_type = std::remove_reference_t<decltype(*container.begin())>;
+      result.pageInfo.encoder = std::make_shared<const CursorEncoder>([to_key](const void* item) {
+         auto bin = eosio::convert_to_bin(to_key(*static_cast<const item_type*>(item)));
+         return eosio::hex(bin.begin(), bin.end());
+      });
+      if (page_begin != page_end)
       {
-         result.pageInfo.startCursor = result.edges.front().cursor;
-         result.pageInfo.endCursor = result.edges.back().cursor;
+         using iterator = decltype(page_begin);
+         if constexpr (element_holding_iterator<iterator>)
+         {
+            auto items = std::make_shared<const std::pair<iterator, iterator>>(
+                page_begin, std::prev(page_end));
+            result.pageInfo.startItem = &*items->first;
+            result.pageInfo.endItem = &*items->second;
+            result.pageInfo.items = std::move(items);
+         }
+         else
+         {
+            result.pageInfo.startItem = &*page_begin;
+            result.pageInfo.endItem = &*std::prev(page_end);
+         }
       }
+      result.count = [&container, rangeBegin, rangeEnd] {
+         return count_range(container, rangeBegin, rangeEnd);
+      };
+      result.edges.for_each = [page_begin, page_end, to_node,
+                               encoder = result.pageInfo.encoder.get()](const auto& f) {
+         for (auto it = page_begin; it != page_end; ++it)
+            if (!f(Edge<config>{to_node(*it), encoder, &*it}))
+               return false;
+         return true;
+      };
       return result;
    }
 }  // namespace clchain
+
+namespace eosio
+{
+   // Lets the schema and query compiler treat EdgeRange as a list of edges
+   template <typename Config>
+   struct is_serializable_container<clchain::EdgeRange<Config>> : std::true_type
+   {
+      using value_type = clchain::Edge<Config>;
+   };
+}  // namespace eosio
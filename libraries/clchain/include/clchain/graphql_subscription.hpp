@@ -0,0 +1,109 @@
+#pragma once
+
+#include <clchain/graphql.hpp>
+#include <map>
+
+namespace clchain
+{
+   // Whether a member of a subscription's root has anything to report. Only optional
+   // members report changes, by being non-empty; the others (e.g. a block number) only
+   // add context to results.
+   template <typename T>
+   constexpr bool gql_has_changes(const T&)
+   {
+      return false;
+   }
+   template <typename T>
+   constexpr bool gql_has_changes(const std::optional<T>& value)
+   {
+      return value.has_value();
+   }
+
+   // Evaluates each member of value, in reflection order, to find the ones which have
+   // changes. Methods which take arguments never report changes. This runs for every new
+   // value, so members should be cheap to evaluate, leaving expensive work to the fields
+   // which queries select.
+   template <typename T>
+   std::vector<bool> gql_changed_members(const T& value)
+   {
+      std::vector<bool> result;
+      eosio_for_each_field((T*)nullptr, [&](const char*, auto member, auto... args) {
+         auto m = member((T*)nullptr);
+         if constexpr (sizeof...(args))
+            result.push_back(false);
+         else if constexpr (std::is_member_function_pointer_v<decltype(m)>)
+            result.push_back(gql_has_changes((value.*m)()));
+         else
+            result.push_back(gql_has_changes(value.*m));
+      });
+      return result;
+   }
+
+   // Queries which are run against each new value of T (e.g. the changes made by a block)
+   // instead of being polled. A subscription only runs when it selects a member of T which
+   // has changes, so clients only hear about what they asked for.
+   template <typename T>
+   struct gql_subscriptions
+   {
+      struct subscription
+      {
+         gql_plan plan;
+         std::string variables;
+      };
+
+      gql_limits limits;
+      std::map<uint32_t, subscription> subscriptions;
+      uint32_t next_id = 1;
+
+      bool empty() const { return subscriptions.empty(); }
+
+      // Returns the new subscription's id. Returns 0 if the query or its variables are
+      // invalid or the query is too expensive.
+      template <typename E>
+      uint32_t subscribe(std::string_view query, std::string_view variables, const E& error)
+      {
+         auto id = next_id;
+         auto& sub = subscriptions[id];
+         gql_context context;
+         if (!gql_compile((T*)nullptr, sub.plan, query, error) ||
+             !gql_bind_variables(sub.plan, variables, context, error))
+         {
+            subscriptions.erase(id);
+            return 0;
+         }
+         if (sub.plan.cost > limits.max_cost)
+         {
+            subscriptions.erase(id);
+            error("query is too expensive; estimated cost " + std::to_string(sub.plan.cost) +
+                  " exceeds " + std::to_string(limits.max_cost));
+            return 0;
+         }
+         sub.variables = variables;
+         ++next_id;
+         return id;
+      }
+
+      bool unsubscribe(uint32_t id) { return subscriptions.erase(id); }
+
+      // Runs the subscriptions which select changed members of value. Calls f(id, result)
+      // for each.
+      template <typename F>
+      void publish(const T& value, F&& f) const
+      {
+         if (subscriptions.empty())
+            return;
+         auto changed = gql_changed_members(value);
+         for (auto& [id, sub] : subscriptions)
+         {
+            for (auto& field : sub.plan.root.selection)
+            {
+               if (field.index < changed.size() && changed[field.index])
+               {
+                  f(id, gql_query(value, sub.plan, sub.variables, limits));
+                  break;
+               }
+            }
+         }
+      }
+   };
+}  // namespace clchain
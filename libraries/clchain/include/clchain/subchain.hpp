@@ -5,6 +5,11 @@
 #include <eosio/fixed_bytes.hpp>
 #include <eosio/name.hpp>
 #include <eosio/time.hpp>
+#include <algorithm>
+#include <compare>
+#include <deque>
+#include <map>
+#include <memory>
 
 namespace subchain
 {
@@ -57,16 +62,54 @@ namespace subchain
    };
    EOSIO_REFLECT(block_with_id, id, base block)
 
+   // A block along with its serialized form (convert_to_bin of the block_with_id), which
+   // block_log keeps so it can hand out blocks without serializing them again
+   struct block_with_bin : block_with_id
+   {
+      std::vector<char> bin;
+   };
+
    inline const block& deref(const block& block) { return block; }
    inline const block& deref(const std::unique_ptr<block>& block) { return *block; }
    inline const block_with_id& deref(const block_with_id& block) { return block; }
-   inline const block_with_id& deref(const std::unique_ptr<block_with_id>& block) { return *block; }
+   inline const block_with_id& deref(const std::shared_ptr<const block_with_bin>& block)
+   {
+      return *block;
+   }
    inline uint32_t get_eosio_num(uint32_t num) { return num; }
    inline uint32_t get_eosio_num(const auto& block) { return deref(block).eosioBlock.num; }
    inline constexpr auto by_eosio_num = [](const auto& a, const auto& b) {
       return get_eosio_num(a) < get_eosio_num(b);
    };
 
+   // Irreversible blocks which a block_log moved out of memory. Holds a contiguous range of
+   // blocks, in serialized form. Implementations must allow reads from any number of threads
+   // while one thread appends.
+   class block_archive
+   {
+     public:
+      virtual ~block_archive() = default;
+
+      // The archive holds blocks [begin_num(), end_num())
+      virtual uint32_t begin_num() const = 0;
+      virtual uint32_t end_num() const = 0;
+
+      // block.num must be end_num(), unless the archive is empty
+      virtual void append(const block_with_bin& block) = 0;
+
+      // Returns the serialized block, or an empty vector if the archive doesn't have it
+      virtual std::vector<char> read(uint32_t num) const = 0;
+
+      std::shared_ptr<const block_with_id> get(uint32_t num) const
+      {
+         auto bin = read(num);
+         if (bin.empty())
+            return nullptr;
+         return std::make_shared<const block_with_id>(
+             eosio::convert_from_bin<block_with_id>(bin));
+      }
+   };
+
    struct block_log
    {
       enum status
@@ -82,9 +125,16 @@ namespace subchain
           "unlinkable",
       };
 
-      std::vector<std::unique_ptr<block_with_id>> blocks;
+      // Blocks in memory: the reversible ones, and at least the last irreversible one. Blocks
+      // don't change once they're in the log, so copies of the log (e.g. for readers on
+      // other threads) may share them.
+      std::deque<std::shared_ptr<const block_with_bin>> blocks;
       uint32_t irreversible = 0;
 
+      // If set, trim moves irreversible blocks here instead of dropping them. Lookups by
+      // num (other than block_range's) and by eosio num only see the blocks in memory.
+      std::shared_ptr<block_archive> archive;
+
       auto lower_bound_by_num(uint32_t num) const
       {
          if (blocks.empty())
@@ -104,14 +154,14 @@ namespace subchain
          return lower_bound_by_num(num + 1);
       }
 
-      const block_with_id* head() const
+      const block_with_bin* head() const
       {
          if (blocks.empty())
             return nullptr;
          return &*blocks.back();
       }
 
-      const block_with_id* block_by_num(uint32_t num) const
+      const block_with_bin* block_by_num(uint32_t num) const
       {
          auto it = lower_bound_by_num(num);
          if (it != blocks.end() && (*it)->num == num)
@@ -119,7 +169,7 @@ namespace subchain
          return nullptr;
       }
 
-      const block_with_id* block_by_eosio_num(uint32_t num) const
+      const block_with_bin* block_by_eosio_num(uint32_t num) const
       {
          auto it = std::lower_bound(blocks.begin(), blocks.end(), num, by_eosio_num);
          if (it != blocks.end() && get_eosio_num(*it) == num)
@@ -127,7 +177,7 @@ namespace subchain
          return nullptr;
       }
 
-      const block_with_id* block_before_num(uint32_t num) const
+      const block_with_bin* block_before_num(uint32_t num) const
       {
          auto it = lower_bound_by_num(num);
          if (it != blocks.begin())
@@ -135,7 +185,7 @@ namespace subchain
          return nullptr;
       }
 
-      const block_with_id* block_before_eosio_num(uint32_t num) const
+      const block_with_bin* block_before_eosio_num(uint32_t num) const
       {
          auto it = std::lower_bound(blocks.begin(), blocks.end(), num, by_eosio_num);
          if (it != blocks.begin())
@@ -143,7 +193,8 @@ namespace subchain
          return nullptr;
       }
 
-      std::pair<status, size_t> add_block(const block_with_id& block)
+      // bin must be block's serialized form, or empty to have add_block serialize it
+      std::pair<status, size_t> add_block(const block_with_id& block, std::vector<char> bin = {})
       {
          size_t num_forked = 0;
          auto it = lower_bound_by_num(block.num);
@@ -158,7 +209,10 @@ namespace subchain
             return {unlinkable, 0};
          num_forked = blocks.end() - it;
          blocks.erase(it, blocks.end());
-         blocks.push_back(std::make_unique<block_with_id>(block));
+         auto stored = std::make_shared<block_with_bin>();
+         static_cast<block_with_id&>(*stored) = block;
+         stored->bin = bin.empty() ? eosio::convert_to_bin(block) : std::move(bin);
+         blocks.push_back(std::move(stored));
          return {appended, num_forked};
       }
 
@@ -174,12 +228,40 @@ namespace subchain
          return num_removed;
       }
 
-      // Keep only 1 irreversible block
+      // Keep only 1 irreversible block in memory
       void trim()
       {
          auto it = lower_bound_by_num(irreversible);
+         if (archive)
+            for (auto b = blocks.begin(); b != it; ++b)
+               if ((*b)->num >= archive->end_num() || archive->begin_num() == archive->end_num())
+                  archive->append(**b);
          blocks.erase(blocks.begin(), it);
       }
+
+      // Makes this log a copy of other, sharing its blocks. Logs only change at their ends,
+      // so updating a copy costs about as much as the changes since the last update.
+      void copy_from(const block_log& other)
+      {
+         irreversible = other.irreversible;
+         archive = other.archive;
+         if (other.blocks.empty())
+         {
+            blocks.clear();
+            return;
+         }
+         blocks.erase(blocks.begin(), lower_bound_by_num(other.blocks.front()->num));
+         while (!blocks.empty())
+         {
+            auto it = other.lower_bound_by_num(blocks.back()->num);
+            if (it != other.blocks.end() && *it == blocks.back())
+               break;
+            blocks.pop_back();
+         }
+         auto it = blocks.empty() ? other.blocks.begin()
+                                  : other.upper_bound_by_num(blocks.back()->num);
+         blocks.insert(blocks.end(), it, other.blocks.end());
+      }
    };
    EOSIO_REFLECT2(block_log, blocks, irreversible)
 
@@ -190,9 +272,106 @@ namespace subchain
                                                      BlockConnection_name,
                                                      BlockEdge_name>>;
 
+   // A block_log's blocks, including archived ones, as a random-access range ordered by
+   // num. Archived blocks are loaded when they're first used, and kept until the range is
+   // destroyed, so references to them stay valid while a query uses them.
+   class block_range
+   {
+     public:
+      class iterator
+      {
+        public:
+         using iterator_category = std::random_access_iterator_tag;
+         using value_type = block_with_id;
+         using difference_type = std::ptrdiff_t;
+         using pointer = const block_with_id*;
+         using reference = const block_with_id&;
+
+         iterator() = default;
+         iterator(const block_range* range, uint32_t num) : range(range), num(num) {}
+
+         reference operator*() const { return *range->find(num); }
+         pointer operator->() const { return range->find(num); }
+         reference operator[](difference_type n) const { return *(*this + n); }
+
+         iterator& operator++() { return ++num, *this; }
+         iterator& operator--() { return --num, *this; }
+         iterator operator++(int) { return {range, num++}; }
+         iterator operator--(int) { return {range, num--}; }
+         iterator& operator+=(difference_type n) { return num += n, *this; }
+         iterator& operator-=(difference_type n) { return num -= n, *this; }
+         friend iterator operator+(iterator it, difference_type n) { return it += n; }
+         friend iterator operator+(difference_type n, iterator it) { return it += n; }
+         friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+         friend difference_type operator-(const iterator& a, const iterator& b)
+         {
+            return difference_type(a.num) - difference_type(b.num);
+         }
+         friend bool operator==(const iterator& a, const iterator& b) { return a.num == b.num; }
+         friend auto operator<=>(const iterator& a, const iterator& b) { return a.num <=> b.num; }
+
+        private:
+         const block_range* range = nullptr;
+         uint32_t num = 0;
+      };
+
+      explicit block_range(const block_log& log) : log(log) {}
+
+      iterator begin() const { return {this, begin_num()}; }
+      iterator end() const { return {this, end_num()}; }
+      iterator lower_bound(uint32_t num) const
+      {
+         return {this, std::clamp(num, begin_num(), end_num())};
+      }
+      iterator upper_bound(uint32_t num) const
+      {
+         if (num == ~uint32_t(0))
+            return end();
+         return lower_bound(num + 1);
+      }
+
+      const block_with_id* find(uint32_t num) const
+      {
+         if (auto* block = log.block_by_num(num))
+            return block;
+         if (num >= begin_num() && num < end_num())
+         {
+            auto& block = loaded[num];
+            if (!block)
+               block = log.archive->get(num);
+            return block.get();
+         }
+         return nullptr;
+      }
+
+     private:
+      // The archive only extends the range if it reaches the blocks in memory
+      bool use_archive() const
+      {
+         return log.archive && log.archive->begin_num() < log.archive->end_num() &&
+                (log.blocks.empty() || log.archive->end_num() >= log.blocks.front()->num);
+      }
+      uint32_t begin_num() const
+      {
+         if (use_archive())
+            return log.archive->begin_num();
+         return log.blocks.empty() ? 0 : log.blocks.front()->num;
+      }
+      uint32_t end_num() const
+      {
+         if (!log.blocks.empty())
+            return log.blocks.back()->num + 1;
+         return use_archive() ? log.archive->end_num() : 0;
+      }
+
+      const block_log& log;
+      mutable std::map<uint32_t, std::shared_ptr<const block_with_id>> loaded;
+   };
+
    struct BlockLog
    {
       block_log& log;
+      block_range range{log};
 
       BlockConnection blocks(std::optional<uint32_t> gt,
                              std::optional<uint32_t> ge,
@@ -201,27 +380,29 @@ namespace subchain
                              std::optional<uint32_t> first,
                              std::optional<uint32_t> last,
                              std::optional<std::string> before,
-                             std::optional<std::string> after) const
+                             std::optional<std::string> after,
+                             std::optional<uint32_t> offset) const
       {
          return clchain::make_connection<BlockConnection, uint32_t>(
-             gt, ge, lt, le, first, last, before, after,     //
-             log.blocks,                                     //
-             [](auto& block) { return block->num; },         //
-             [](auto& block) { return std::cref(*block); },  //
-             [&](auto& blocks, auto block_num) { return log.lower_bound_by_num(block_num); },
-             [&](auto& blocks, auto block_num) { return log.upper_bound_by_num(block_num); });
+             gt, ge, lt, le, first, last, before, after, offset,  //
+             range,                                               //
+             [](auto& block) { return block.num; },               //
+             [](auto& block) { return std::cref(block); },        //
+             [](auto& range, auto block_num) { return range.lower_bound(block_num); },
+             [](auto& range, auto block_num) { return range.upper_bound(block_num); });
       }
 
       const block_with_id* head() const { return log.head(); }
-      const block_with_id* irreversible() const { return log.block_by_num(log.irreversible); }
-      const block_with_id* blockByNum(uint32_t num) const { return log.block_by_num(num); }
+      const block_with_id* irreversible() const { return range.find(log.irreversible); }
+      const block_with_id* blockByNum(uint32_t num) const { return range.find(num); }
       const block_with_id* blockByEosioNum(uint32_t num) const
       {
          return log.block_by_eosio_num(num);
       }
    };
    EOSIO_REFLECT2(BlockLog,
-                  method(blocks, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
+                  method(blocks, "gt", "ge", "lt", "le", "first", "last", "before", "after",
+                         "offset"),
                   head,
                   irreversible,
                   method(blockByNum, "num"),
@@ -0,0 +1,198 @@
+#include <clchain/block_file.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+// Appends to a block_file, reopens it, and checks that reopening recovers from a data or
+// index file which an interrupted append left short, or which was never written.
+
+int error_count;
+
+void report_error(const char* assertion, const char* file, int line)
+{
+   if (error_count <= 20)
+   {
+      std::printf("%s:%d: failed %s\n", file, line, assertion);
+   }
+   ++error_count;
+}
+
+#define CHECK(...)                                       \
+   do                                                    \
+   {                                                     \
+      if (__VA_ARGS__)                                   \
+      {                                                  \
+      }                                                  \
+      else                                               \
+      {                                                  \
+         report_error(#__VA_ARGS__, __FILE__, __LINE__); \
+      }                                                  \
+   } while (0)
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t first_num = 5;
+constexpr uint32_t header_size = 16;
+
+// Contents of block num; sizes vary so that offsets matter
+std::vector<char> bin_for(uint32_t num)
+{
+   std::vector<char> result(num % 7 + 1);
+   for (std::size_t i = 0; i < result.size(); ++i)
+      result[i] = char(num * 31 + i);
+   return result;
+}
+
+void append(subchain::block_file& file, uint32_t num)
+{
+   subchain::block_with_bin block;
+   block.num = num;
+   block.bin = bin_for(num);
+   file.append(block);
+}
+
+// Checks that file holds exactly blocks [first_num, end)
+void check_blocks(const subchain::block_file& file, uint32_t end)
+{
+   CHECK(file.begin_num() == (end > first_num ? first_num : 0));
+   CHECK(file.end_num() == (end > first_num ? end : 0));
+   for (uint32_t num = first_num; num < end; ++num)
+      CHECK(file.read(num) == bin_for(num));
+   CHECK(file.read(first_num - 1).empty());
+   CHECK(file.read(end).empty());
+}
+
+uint64_t data_size(uint32_t end)
+{
+   uint64_t result = 0;
+   for (uint32_t num = first_num; num < end; ++num)
+      result += bin_for(num).size();
+   return result;
+}
+
+int main()
+{
+   auto dir = fs::temp_directory_path() / ("test-block-file-" + std::to_string(getpid()));
+   fs::remove_all(dir);
+   fs::create_directories(dir);
+   auto path = dir / "blocks";
+   auto index_path = fs::path{path.string() + ".index"};
+
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 0);
+      for (uint32_t num = first_num; num < 20; ++num)
+         append(file, num);
+      check_blocks(file, 20);
+
+      bool threw = false;
+      try
+      {
+         append(file, 21);
+      }
+      catch (std::runtime_error&)
+      {
+         threw = true;
+      }
+      CHECK(threw);
+      check_blocks(file, 20);
+   }
+
+   // Reopening keeps everything
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 20);
+   }
+
+   // The last block's data is cut short: it's dropped, and appending resumes from it
+   fs::resize_file(path, data_size(20) - 1);
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 19);
+      CHECK(fs::file_size(path) == data_size(19));
+      CHECK(fs::file_size(index_path) == header_size + (19 - first_num) * 8);
+      append(file, 19);
+      check_blocks(file, 20);
+   }
+
+   // An index entry is cut short: its block is dropped from both files
+   fs::resize_file(index_path, fs::file_size(index_path) - 3);
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 19);
+      CHECK(fs::file_size(path) == data_size(19));
+      CHECK(fs::file_size(index_path) == header_size + (19 - first_num) * 8);
+   }
+
+   // Data which the index doesn't cover yet is dropped
+   {
+      std::FILE* f = std::fopen(path.c_str(), "ab");
+      std::fputs("partial", f);
+      std::fclose(f);
+   }
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 19);
+      CHECK(fs::file_size(path) == data_size(19));
+   }
+
+   // Without a complete header the files start over, from whichever block comes next
+   fs::resize_file(index_path, header_size - 1);
+   {
+      subchain::block_file file{path};
+      check_blocks(file, 0);
+      CHECK(fs::file_size(path) == 0);
+      for (uint32_t num = first_num; num < 20; ++num)
+         append(file, num);
+      check_blocks(file, 20);
+   }
+
+   // Readers on other threads see whole blocks while one thread appends
+   fs::remove(path);
+   fs::remove(index_path);
+   {
+      subchain::block_file file{path};
+      std::atomic<bool> done = false;
+      std::thread reader{[&] {
+         while (!done)
+         {
+            // Blocks are never removed, so every block before end stays readable
+            auto end = file.end_num();
+            auto begin = file.begin_num();
+            CHECK(begin == 0 || begin == first_num);
+            for (auto num = begin; num < end; ++num)
+               CHECK(file.read(num) == bin_for(num));
+         }
+      }};
+      for (uint32_t num = first_num; num < 2000; ++num)
+         append(file, num);
+      done = true;
+      reader.join();
+      check_blocks(file, 2000);
+   }
+
+   // Files which aren't block indexes are rejected
+   {
+      std::FILE* f = std::fopen(index_path.c_str(), "r+b");
+      std::fputs("junk", f);
+      std::fclose(f);
+      bool threw = false;
+      try
+      {
+         subchain::block_file file{path};
+      }
+      catch (std::runtime_error&)
+      {
+         threw = true;
+      }
+      CHECK(threw);
+   }
+
+   fs::remove_all(dir);
+   if (error_count)
+      return 1;
+}
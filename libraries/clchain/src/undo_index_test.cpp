@@ -0,0 +1,386 @@
+#include <chainbase/chainbase.hpp>
+
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/key.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/ranked_index.hpp>
+#include <boost/multi_index_container.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+// Runs random operations against an undo_index and a reference model, and compares them:
+// contents, ranked indices' rank and nth, hashed lookups, and the contents at earlier
+// revisions, across nested sessions which are pushed, undone, squashed, and committed.
+
+int error_count;
+
+void report_error(const char* assertion, const char* file, int line)
+{
+   if (error_count <= 20)
+   {
+      std::printf("%s:%d: failed %s\n", file, line, assertion);
+   }
+   ++error_count;
+}
+
+#define CHECK(...)                                       \
+   do                                                    \
+   {                                                     \
+      if (__VA_ARGS__)                                   \
+      {                                                  \
+      }                                                  \
+      else                                               \
+      {                                                  \
+         report_error(#__VA_ARGS__, __FILE__, __LINE__); \
+      }                                                  \
+   } while (0)
+
+struct by_id;
+struct by_key;
+struct by_name;
+
+struct test_object : chainbase::object<0, test_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(test_object)
+
+   id_type id;
+   uint32_t key = 0;
+   uint32_t name = 0;
+   uint32_t value = 0;
+   uint32_t counter = 0;
+
+   auto undo_fields() { return std::tie(counter); }
+};
+
+using test_index = chainbase::generic_index<boost::multi_index_container<
+    test_object,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<boost::multi_index::tag<by_id>,
+                                           boost::multi_index::key<&test_object::id>>,
+        boost::multi_index::ranked_unique<boost::multi_index::tag<by_key>,
+                                          boost::multi_index::key<&test_object::key>>,
+        boost::multi_index::hashed_unique<boost::multi_index::tag<by_name>,
+                                          boost::multi_index::key<&test_object::name>>>,
+    chainbase::allocator<test_object>>>;
+
+using key_index_traits = chainbase::offset_node_traits<boost::multi_index::ranked_unique<
+    boost::multi_index::tag<by_key>,
+    boost::multi_index::key<&test_object::key>>>;
+
+struct row
+{
+   uint32_t key;
+   uint32_t name;
+   uint32_t value;
+   uint32_t counter;
+
+   friend bool operator==(const row&, const row&) = default;
+};
+
+struct model
+{
+   std::map<int64_t, row> rows;
+   int64_t next_id = 0;
+
+   // Rows which the top undo session created or already backed up. A modify which violates
+   // a uniqueness constraint reverts the row if it has a fresh backup, and removes it if not.
+   std::set<int64_t> backed_up;
+
+   bool has_key(uint32_t key) const
+   {
+      return std::any_of(rows.begin(), rows.end(), [&](auto& r) { return r.second.key == key; });
+   }
+   bool has_name(uint32_t name) const
+   {
+      return std::any_of(rows.begin(), rows.end(),
+                         [&](auto& r) { return r.second.name == name; });
+   }
+};
+
+row to_row(const test_object& obj)
+{
+   return {obj.key, obj.name, obj.value, obj.counter};
+}
+
+bool same_contents(const test_index& table, const model& m)
+{
+   if (table.size() != m.rows.size() || table.next_id()._id != m.next_id)
+      return false;
+   auto it = m.rows.begin();
+   for (auto& obj : table)
+   {
+      if (obj.id._id != it->first || !(to_row(obj) == it->second))
+         return false;
+      ++it;
+   }
+   return true;
+}
+
+// Compares for_each_at_revision with the model
+bool same_contents_at(const test_index& table, int64_t revision, const model& m)
+{
+   if (table.next_id_at_revision(revision)._id != m.next_id)
+      return false;
+   bool same = true;
+   auto it = m.rows.begin();
+   table.for_each_at_revision(revision, [&](const test_object& obj) {
+      if (it == m.rows.end() || obj.id._id != it->first || !(to_row(obj) == it->second))
+         same = false;
+      else
+         ++it;
+   });
+   return same && it == m.rows.end();
+}
+
+void check_table(const test_index& table, const model& m, std::mt19937& rng)
+{
+   CHECK(same_contents(table, m));
+
+   std::vector<uint32_t> keys;
+   for (auto& [id, r] : m.rows)
+      keys.push_back(r.key);
+   std::sort(keys.begin(), keys.end());
+   auto& by_keys = table.get<by_key>();
+   CHECK(by_keys.nth(keys.size()) == by_keys.end());
+   CHECK(by_keys.rank(by_keys.end()) == keys.size());
+   for (int i = 0; i < 10 && !keys.empty(); ++i)
+   {
+      auto pos = rng() % keys.size();
+      auto it = by_keys.nth(pos);
+      CHECK(it != by_keys.end() && it->key == keys[pos]);
+      CHECK(by_keys.rank(by_keys.find(keys[pos])) == pos);
+      auto probe = uint32_t(rng() % 1000);
+      CHECK(by_keys.lower_bound_rank(probe) ==
+            std::size_t(std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin()));
+      CHECK(by_keys.upper_bound_rank(probe) ==
+            std::size_t(std::upper_bound(keys.begin(), keys.end(), probe) - keys.begin()));
+   }
+
+   auto& by_names = table.get<by_name>();
+   CHECK(by_names.size() == m.rows.size());
+   for (auto& [id, r] : m.rows)
+   {
+      auto it = by_names.find(r.name);
+      CHECK(it != by_names.end() && it->id._id == id);
+   }
+   for (int i = 0; i < 10; ++i)
+   {
+      auto name = uint32_t(rng() % 1000);
+      CHECK((by_names.find(name) != by_names.end()) == m.has_name(name));
+   }
+}
+
+// Picks a random existing row
+const test_object* random_object(const test_index& table, std::mt19937& rng)
+{
+   if (table.empty())
+      return nullptr;
+   return &*table.get<by_key>().nth(rng() % table.size());
+}
+
+void run(uint32_t seed, int num_ops)
+{
+   std::mt19937 rng{seed};
+   test_index table;
+   model current;
+   std::vector<model> sessions;  // the model at the start of each session on the undo stack
+
+   for (int op = 0; op < num_ops; ++op)
+   {
+      switch (rng() % 17)
+      {
+         case 0:
+         case 1:
+         case 2:
+         {
+            row r{uint32_t(rng() % 1000), uint32_t(rng() % 1000), uint32_t(rng()), 0};
+            bool conflicts = current.has_key(r.key) || current.has_name(r.name);
+            bool threw = false;
+            try
+            {
+               table.emplace([&](auto& obj) {
+                  obj.key = r.key;
+                  obj.name = r.name;
+                  obj.value = r.value;
+               });
+            }
+            catch (std::runtime_error&)
+            {
+               threw = true;
+            }
+            CHECK(threw == conflicts);
+            if (!conflicts)
+            {
+               if (!sessions.empty())
+                  current.backed_up.insert(current.next_id);
+               current.rows[current.next_id++] = r;
+            }
+            break;
+         }
+         case 3:
+         case 4:
+         case 5:
+         {
+            auto* obj = random_object(table, rng);
+            if (!obj)
+               break;
+            auto& r = current.rows[obj->id._id];
+            auto updated = r;
+            if (rng() % 2)
+               updated.key = rng() % 1000;
+            if (rng() % 2)
+               updated.name = rng() % 1000;
+            updated.value = rng();
+            bool conflicts = (updated.key != r.key && current.has_key(updated.key)) ||
+                             (updated.name != r.name && current.has_name(updated.name));
+            bool threw = false;
+            try
+            {
+               table.modify(*obj, [&](auto& obj) {
+                  obj.key = updated.key;
+                  obj.name = updated.name;
+                  obj.value = updated.value;
+               });
+            }
+            catch (std::runtime_error&)
+            {
+               threw = true;
+            }
+            CHECK(threw == conflicts);
+            auto id = obj->id._id;
+            bool has_backup = !sessions.empty() && !current.backed_up.count(id);
+            if (!conflicts)
+               r = updated;
+            else if (!has_backup)
+               current.rows.erase(id);
+            if (!sessions.empty())
+               current.backed_up.insert(id);
+            break;
+         }
+         case 6:
+         case 7:
+         case 8:
+         {
+            auto* obj = random_object(table, rng);
+            if (!obj)
+               break;
+            auto counter = uint32_t(rng());
+            current.rows[obj->id._id].counter = counter;
+            table.modify_fields(*obj, [&](auto& obj) { obj.counter = counter; });
+            break;
+         }
+         case 9:
+         case 10:
+         case 11:
+         {
+            auto* obj = random_object(table, rng);
+            if (!obj)
+               break;
+            current.rows.erase(obj->id._id);
+            table.remove(*obj);
+            break;
+         }
+         case 12:
+         case 13:
+            sessions.push_back(current);
+            current.backed_up.clear();
+            table.start_undo_session(true).push();
+            break;
+         case 14:
+            if (sessions.empty())
+               break;
+            current = std::move(sessions.back());
+            sessions.pop_back();
+            table.undo();
+            break;
+         case 15:
+            if (sessions.empty())
+               break;
+            current.backed_up.insert(sessions.back().backed_up.begin(),
+                                     sessions.back().backed_up.end());
+            sessions.pop_back();
+            table.squash();
+            break;
+         case 16:
+         {
+            if (sessions.empty())
+               break;
+            auto keep = rng() % sessions.size();
+            sessions.erase(sessions.begin(), sessions.end() - keep);
+            table.commit(table.revision() - keep);
+            break;
+         }
+      }
+      auto [first, last] = table.undo_stack_revision_range();
+      CHECK(last - first == int64_t(sessions.size()));
+      check_table(table, current, rng);
+      CHECK(same_contents_at(table, last, current));
+      if (!sessions.empty())
+      {
+         auto i = rng() % sessions.size();
+         CHECK(same_contents_at(table, first + i, sessions[i]));
+      }
+      if (error_count)
+      {
+         std::printf("seed %u, op %d\n", seed, op);
+         return;
+      }
+   }
+
+   while (!sessions.empty())
+   {
+      current = std::move(sessions.back());
+      sessions.pop_back();
+      table.undo();
+      check_table(table, current, rng);
+   }
+
+   // Copies keep their ids and build the same indices
+   test_index copy;
+   for (auto& obj : table)
+      copy.insert_copy(obj);
+   copy.set_next_id(table.next_id());
+   CHECK(same_contents(copy, current));
+   check_table(copy, current, rng);
+}
+
+// Forces the ranked index to recompute every subtree size, as it does if its list of
+// changed nodes overflows
+void test_changed_nodes_overflow()
+{
+   std::mt19937 rng{1};
+   test_index table;
+   model current;
+   for (uint32_t i = 0; i < 200; ++i)
+   {
+      key_index_traits::changed_nodes().overflowed = i % 3 == 0;
+      auto& obj = table.emplace([&](auto& obj) {
+         obj.key = i * 7 % 200;
+         obj.name = i;
+      });
+      current.rows[obj.id._id] = to_row(obj);
+      ++current.next_id;
+   }
+   for (uint32_t i = 0; i < 200; i += 2)
+   {
+      key_index_traits::changed_nodes().overflowed = i % 4 == 0;
+      table.remove(table.get(test_object::id_type(i)));
+      current.rows.erase(i);
+   }
+   check_table(table, current, rng);
+}
+
+int main()
+{
+   for (uint32_t seed = 0; seed < 50 && !error_count; ++seed)
+      run(seed, 2000);
+   test_changed_nodes_overflow();
+   if (error_count)
+      return 1;
+}
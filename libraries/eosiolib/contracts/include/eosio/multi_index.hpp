@@ -672,7 +672,7 @@ namespace eosio
             return n.value != 0 && n != "primary"_n;  // Primary is a reserve index name.
          }
 
-         static_assert(validate_index_name(name(IndexName)),
+         static_assert(validate_index_name(eosio::name(IndexName)),
                        "invalid index name used in multi_index");
 
          enum constants
@@ -95,6 +95,8 @@ export const subchainConfig = {
     atomicMarket: process.env.SUBCHAIN_AA_MARKET_CONTRACT || "atomicmarket",
     wasmFile: process.env.SUBCHAIN_WASM || "../../build/eden-micro-chain.wasm",
     stateFile: process.env.SUBCHAIN_STATE || "state",
+    historyRetentionDays:
+        +(process.env.SUBCHAIN_HISTORY_RETENTION_DAYS as any) || 0,
     receiver:
         SubchainReceivers[
             (process.env.SUBCHAIN_RECEIVER ||
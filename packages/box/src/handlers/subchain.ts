@@ -13,6 +13,8 @@ import {
 } from "@edenos/eden-subchain-client/dist/SubchainProtocol";
 
 const storage = new Storage();
+// Blocks are fetched from the micro-chain in batches of up to this size
+const maxBytesPerBatch = 1024 * 1024;
 export const subchainHandler = express.Router();
 
 subchainHandler.get("/eden-micro-chain.wasm", (req, res) => {
@@ -77,24 +79,34 @@ class ConnectionState {
                 }
             }
             while (this.status.maxBlocksToSend > 0) {
-                let needBlock = this.head() + 1;
-                if (needBlock > storage.head) break;
-                const block = storage.getBlock(needBlock);
-                if (!block) throw new Error("Missing block");
-                this.ws.send(block);
-                this.status.maxBlocksToSend--;
-                this.status.blocks.push({
-                    num: needBlock,
-                    id: storage.idForNum(needBlock),
-                });
-                needHeadUpdate = false;
-                let irreversible = Math.min(
-                    storage.blocksWasm!.getIrreversible(),
-                    this.head()
+                const firstBlock = this.head() + 1;
+                if (firstBlock > storage.head) break;
+                const blocks = storage.getBlocks(
+                    firstBlock,
+                    Math.min(
+                        storage.head,
+                        firstBlock + this.status.maxBlocksToSend - 1
+                    ),
+                    maxBytesPerBatch
                 );
-                if (irreversible > this.status.irreversible) {
-                    this.sendMsg({ type: "setIrreversible", irreversible });
-                    this.status.irreversible = irreversible;
+                if (!blocks.length) throw new Error("Missing block");
+                for (const block of blocks) {
+                    const needBlock = this.head() + 1;
+                    this.ws.send(block);
+                    this.status.maxBlocksToSend--;
+                    this.status.blocks.push({
+                        num: needBlock,
+                        id: storage.idForNum(needBlock),
+                    });
+                    needHeadUpdate = false;
+                    let irreversible = Math.min(
+                        storage.blocksWasm!.getIrreversible(),
+                        this.head()
+                    );
+                    if (irreversible > this.status.irreversible) {
+                        this.sendMsg({ type: "setIrreversible", irreversible });
+                        this.status.irreversible = irreversible;
+                    }
                 }
             }
             // TODO: trim status.blocks
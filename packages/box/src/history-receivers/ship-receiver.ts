@@ -8,6 +8,7 @@ export class ShipReceiver {
     storage: Storage;
     wsClient: WebSocket | undefined;
     requestedBlocks = false;
+    pendingMessages: Uint8Array[] = [];
 
     constructor(storage: Storage) {
         this.storage = storage;
@@ -66,9 +67,18 @@ export class ShipReceiver {
             this.wsClient!.send(request);
             logger.info("Requested Blocks from SHiP!");
         } else {
-            const bytes = new Uint8Array(data as ArrayBuffer);
-            this.storage.pushShipMessage(bytes);
-            this.storage.saveState();
+            // Messages which arrive together (e.g. while catching up) are
+            // pushed and saved as one batch
+            if (!this.pendingMessages.length)
+                setImmediate(() => this.flushMessages());
+            this.pendingMessages.push(new Uint8Array(data as ArrayBuffer));
         }
     }
+
+    flushMessages() {
+        const messages = this.pendingMessages;
+        this.pendingMessages = [];
+        this.storage.pushShipMessages(messages);
+        this.storage.saveState();
+    }
 }
@@ -37,6 +37,11 @@ export class Storage {
                 atomicAccount,
                 atomicmarketAccount
             );
+
+            for (const wasm of [this.blocksWasm, this.stateWasm])
+                wasm.setHistoryRetention(
+                    config.subchainConfig.historyRetentionDays
+                );
         } catch (e) {
             this.blocksWasm = null;
             this.stateWasm = null;
@@ -80,6 +85,12 @@ export class Storage {
         return this.protect(() => this.blocksWasm!.getBlock(num))!;
     }
 
+    getBlocks(from: number, to: number, maxBytes: number): Uint8Array[] {
+        return this.protect(() =>
+            this.blocksWasm!.getBlocks(from, to, maxBytes)
+        )!;
+    }
+
     idForNum(num: number): string {
         return this.query(`{blockLog{blockByNum(num:${num}){id}}}`).data
             .blockLog.blockByNum.id;
@@ -137,4 +148,15 @@ export class Storage {
         this.changed();
         return result;
     }
+
+    pushShipMessages(shipMessages: Uint8Array[]) {
+        const result = this.protect(() => {
+            const result = this.blocksWasm!.pushShipMessages(shipMessages);
+            this.stateWasm!.pushShipMessages(shipMessages);
+            this.stateWasm!.trimBlocks();
+            return result;
+        });
+        this.changed();
+        return result;
+    }
 }
@@ -201,6 +201,34 @@ export class EdenSubchain {
         });
     }
 
+    // Returns one status per message: true if it added a block
+    pushShipMessages(messages: Uint8Array[]): boolean[] {
+        return this.protect(() => {
+            const buf = new Serialize.SerialBuffer();
+            for (const message of messages) {
+                buf.pushVarUint32(message.length);
+                buf.pushArray(message);
+            }
+            const batch = buf.asUint8Array();
+            this.withData(batch, (addr) => {
+                this.exports.pushShipMessages(
+                    addr,
+                    batch.length,
+                    messages.length
+                );
+            });
+            return Array.from(this.resultAsUint8Array(), (status) => !!status);
+        });
+    }
+
+    // Balance history older than this many days is folded into daily rollups,
+    // which Balance.history still returns. 0 keeps all of it.
+    setHistoryRetention(days: number) {
+        this.protect(() => {
+            this.exports.setHistoryRetention(days);
+        });
+    }
+
     trimBlocks() {
         this.protect(() => {
             this.exports.trimBlocks();
@@ -226,6 +254,35 @@ export class EdenSubchain {
         });
     }
 
+    // Returns blocks from through to, stopping early at a missing block or
+    // before exceeding maxBytes (but always including from if it exists)
+    getBlocks(from: number, to: number, maxBytes: number): Uint8Array[] {
+        return this.protect(() => {
+            const count = this.exports.getBlocks(from, to, maxBytes);
+            const buf = new Serialize.SerialBuffer({
+                array: new Uint8Array(this.resultAsUint8Array()),
+            });
+            const blocks = [];
+            for (let i = 0; i < count; ++i) blocks.push(buf.getBytes());
+            return blocks;
+        });
+    }
+
+    exportSnapshot() {
+        return this.protect(() => {
+            this.exports.exportSnapshot();
+            return new Uint8Array(this.resultAsUint8Array());
+        });
+    }
+
+    importSnapshot(snapshot: Uint8Array) {
+        this.protect(() => {
+            this.withData(snapshot, (addr) => {
+                this.exports.importSnapshot(addr, snapshot.length);
+            });
+        });
+    }
+
     getSchema() {
         if (!this.schema.length)
             this.schema = this.decodeStr(
@@ -235,16 +292,91 @@ export class EdenSubchain {
         return this.schema;
     }
 
-    query(q: string) {
+    query(q: string, variables?: any) {
         const utf8 = new TextEncoder().encode(q);
+        const varsUtf8 = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
         return this.protect(() => {
             return this.withData(utf8, (addr) => {
-                this.exports.query(addr, utf8.length, 0, 0);
+                if (!varsUtf8.length)
+                    this.exports.query(addr, utf8.length, 0, 0);
+                else
+                    this.withData(varsUtf8, (varsAddr) => {
+                        this.exports.query(
+                            addr,
+                            utf8.length,
+                            varsAddr,
+                            varsUtf8.length
+                        );
+                    });
                 return JSON.parse(this.resultAsString());
             });
         });
     }
 
+    // Limits on the estimated cost of queries and subscriptions, and on the
+    // fields and list items they visit. 0 removes a limit.
+    setQueryLimits(maxCost: number, maxSteps: number) {
+        this.protect(() => {
+            this.exports.setQueryLimits(maxCost, maxSteps);
+        });
+    }
+
+    // Records the changes made by each block for getBlockDeltas
+    setRecordDeltas(enable: boolean) {
+        this.protect(() => {
+            this.exports.setRecordDeltas(enable);
+        });
+    }
+
+    // Returns the deltas recorded since the last call. The format is described
+    // in eden-micro-chain.cpp.
+    getBlockDeltas() {
+        return this.protect(() => {
+            this.exports.getBlockDeltas();
+            return new Uint8Array(this.resultAsUint8Array());
+        });
+    }
+
+    // Runs q against the changes made by each new block. Returns the
+    // subscription's id.
+    subscribe(q: string, variables?: any): number {
+        const utf8 = new TextEncoder().encode(q);
+        const varsUtf8 = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
+        const id = this.protect(() =>
+            this.withData(utf8, (addr) => {
+                if (!varsUtf8.length)
+                    return this.exports.subscribe(addr, utf8.length, 0, 0);
+                return this.withData(varsUtf8, (varsAddr) =>
+                    this.exports.subscribe(
+                        addr,
+                        utf8.length,
+                        varsAddr,
+                        varsUtf8.length
+                    )
+                );
+            })
+        );
+        if (!id)
+            throw new Error(JSON.parse(this.resultAsString()).errors.message);
+        return id;
+    }
+
+    unsubscribe(id: number): boolean {
+        return this.protect(() => !!this.exports.unsubscribe(id));
+    }
+
+    // Returns the subscription results produced since the last call
+    getSubscriptionResults(): { id: number; block: number; result: any }[] {
+        return this.protect(() => {
+            this.exports.getSubscriptionResults();
+            return JSON.parse(this.resultAsString());
+        });
+    }
+
     getIrreversible(): number {
         const q = this.query(`{
             blockLog{
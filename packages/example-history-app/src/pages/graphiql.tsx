@@ -7,7 +7,8 @@ import { EdenChainContext } from "@edenos/eden-subchain-client/dist/ReactSubchai
 import { EdenSubchain } from "@edenos/eden-subchain-client/dist/EdenSubchain";
 
 function createFetcher(subchain: EdenSubchain) {
-    return async ({ query }: { query: string }) => subchain.query(query);
+    return async ({ query, variables }: { query: string; variables?: any }) =>
+        subchain.query(query, variables);
 }
 
 const defaultQuery = `# GraphiQL is talking to a WASM running in the browser.
@@ -10,7 +10,8 @@ import { EdenSubchain } from "@edenos/eden-subchain-client/dist/EdenSubchain";
 import "../../../../node_modules/graphiql/graphiql.min.css";
 
 function createFetcher(subchain: EdenSubchain) {
-    return async ({ query }: { query: string }) => subchain.query(query);
+    return async ({ query, variables }: { query: string; variables?: any }) =>
+        subchain.query(query, variables);
 }
 
 const defaultQuery = `# GraphiQL is talking to a WASM running in the browser.